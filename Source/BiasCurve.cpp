@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BiasCurve.h"
+
+#include <algorithm>
+#include <cmath>
+
+BiasCurve::BiasCurve(int num_lines, floattype sample_rate, floattype bias)
+{
+    values.resize(num_lines);
+    decibels.resize(num_lines);
+    floattype left = num_lines * (floattype)60 / (sample_rate / 2);
+    floattype right = num_lines * (floattype)20000 / (sample_rate / 2);
+    const floattype PI = 3.14159265359;
+    
+    // DUCK: by lowering the threshold when the bias is in the middle, we keep the overall threshold low-point
+    // about the same at all bias settings, so that audio doesn't come in and out wildly when the bias is changed.
+    // This way, users can change the sound with the bias slider alone, without having to move the threshold level
+    // sliders simultaneously.
+    floattype duck = std::cos(bias * PI / 4.0);
+    const floattype duck_amount = -2.0;
+    const floattype sharpness = 5;
+    floattype input, rawcurve;
+    for (int f = 0; f < num_lines; ++f) {
+        // Input rescales left -- right to a log scale between 0 and 1.
+        input = std::log((floattype) f / left) / std::log(right / left);
+        rawcurve = (atan((input - 0.5) * sharpness) / PI) * 6 * (-bias);
+        values[f] = std::pow(10.0, rawcurve + duck * duck_amount);
+        decibels[f] = std::log10(values[f]) * 10;
+        // bias_curve[f] = std::max(((atan((input - 0.5) * sharpness) / PI) * 2 * (-new_bias) + 1) / 2, 0.0);
+    }
+}
+
+floattype BiasCurve::quantize(floattype bias)
+{
+    return std::round(bias / STEP) * STEP;
+}
+
+int BiasCurve::step_index(floattype bias)
+{
+    const int step = (int)std::round((bias - MIN_BIAS) / STEP);
+    return std::clamp(step, 0, NUM_STEPS - 1);
+}
+
+floattype BiasCurve::step_bias(int step)
+{
+    return quantize(MIN_BIAS + step * STEP);
+}
+
+std::shared_ptr<const BiasCurve> BiasCurve::get(int num_lines,
+                                                floattype sample_rate,
+                                                floattype bias)
+{
+    // Unlike the static thresholds, the cache holds on to the curves, so that
+    // moving the bias back and forth doesn't keep making the same ones. Once
+    // it's full, it lets go of the ones nobody's using, starting with the ones
+    // that were last asked for longest ago, until the new one fits.
+    struct CachedCurve {
+        std::shared_ptr<const BiasCurve> curve;
+        unsigned long long last_used;
+    };
+    static std::mutex cache_lock;
+    static std::map<std::tuple<int, floattype, floattype>, CachedCurve> cache;
+    static size_t cached_values = 0;
+    static unsigned long long clock = 0;
+    
+    bias = quantize(bias);
+    const auto key = std::make_tuple(num_lines, sample_rate, bias);
+    std::unique_lock<std::mutex> lock(cache_lock);
+    ++clock;
+    auto found = cache.find(key);
+    if (found != cache.end()) {
+        found->second.last_used = clock;
+        return found->second.curve;
+    }
+    
+    // Making a curve takes a while at the bigger sizes, so we don't keep
+    // other instances waiting while we do. If one of them made the same one in
+    // the meantime, we use theirs.
+    lock.unlock();
+    std::shared_ptr<const BiasCurve> curve = std::make_shared<const BiasCurve>(num_lines, sample_rate, bias);
+    lock.lock();
+    ++clock;
+    found = cache.find(key);
+    if (found != cache.end()) {
+        found->second.last_used = clock;
+        return found->second.curve;
+    }
+    
+    // Each curve holds its values twice, as powers and in dB.
+    const size_t curve_values = 2 * (size_t)num_lines;
+    if (cached_values + curve_values > MAX_CACHED_VALUES) {
+        std::vector<decltype(cache)::iterator> unused;
+        for (auto entry = cache.begin(); entry != cache.end(); ++entry) {
+            if (entry->second.curve.use_count() == 1) {
+                unused.push_back(entry);
+            }
+        }
+        std::sort(unused.begin(), unused.end(), [](const auto& a, const auto& b) {
+            return a->second.last_used < b->second.last_used;
+        });
+        for (auto entry : unused) {
+            if (cached_values + curve_values <= MAX_CACHED_VALUES) {
+                break;
+            }
+            cached_values -= 2 * entry->second.curve->values.size();
+            cache.erase(entry);
+        }
+    }
+    cache[key] = { curve, clock };
+    cached_values += curve_values;
+    return curve;
+}
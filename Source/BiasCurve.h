@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ The bias: a gain for each frequency line that tilts the thresholds towards the low or high frequencies. It only depends on the number of lines, the sample rate and the bias setting, so every channel shares one, as does any other instance of the plugin with the same settings. The bias is snapped to a grid of BiasCurve::STEP, and the EmpyModel gets the curve for every step of the grid at every resolution when it's prepared, so automating the bias just picks a curve that's already made.
+ */
+
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "utils.h"
+
+class BiasCurve {
+public:
+    // A 64th of the bias slider's unit is far finer than anyone can hear: the
+    // curve's ends move by less than 0.2 dB between steps.
+    static constexpr floattype STEP = (floattype)1 / 64;
+    // The bias slider's range, and so the grid's.
+    static constexpr floattype MIN_BIAS = -2;
+    static constexpr floattype MAX_BIAS = 2;
+    static constexpr int NUM_STEPS = (int)((MAX_BIAS - MIN_BIAS) / STEP) + 1;
+    // The cache lets go of curves nobody's using once it holds more than this
+    // many values, starting with the ones used longest ago. A curve has two
+    // values per line (see below), and the resolutions from 4 to 4096 lines
+    // add up to 8188 lines, so this is the whole grid for one sample rate
+    // (257 steps * 8188 lines * 2, about 16 MB of floats). An instance at
+    // another sample rate pushes out the curves nobody's using, such as the
+    // grid for a sample rate we've moved on from.
+    static constexpr size_t MAX_CACHED_VALUES = (size_t)NUM_STEPS * 8188 * 2;
+    
+    BiasCurve(int num_lines, floattype sample_rate, floattype bias);
+    
+    // The bias, snapped to the grid the curves are made on.
+    static floattype quantize(floattype bias);
+    // Which step of the grid the bias is on, from 0 to NUM_STEPS - 1. Biases
+    // outside the slider's range get the step at its nearest end.
+    static int step_index(floattype bias);
+    // The bias at a step of the grid.
+    static floattype step_bias(int step);
+    
+    // Returns the curve for the bias (snapped to the grid), making it if it
+    // isn't in the cache. This can wait on a lock and allocate, so it's not
+    // for the audio thread: the EmpyModel gets the whole grid in prepare().
+    static std::shared_ptr<const BiasCurve> get(int num_lines,
+                                                floattype sample_rate,
+                                                floattype bias);
+    
+    // A gain (as a power) for each frequency line.
+    std::vector<floattype> values;
+    // The same in dB, for the graph.
+    std::vector<floattype> decibels;
+};
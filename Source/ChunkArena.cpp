@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ChunkArena.h"
+
+#include <algorithm>
+#include <new>
+
+ChunkArena::ChunkArena()
+{
+}
+
+ChunkArena::ChunkArena(int n_channels, int n_lines)
+{
+    num_channels = n_channels;
+    num_lines = n_lines;
+    
+    constexpr std::size_t per_line = ALIGNMENT / sizeof(floattype);
+    std::size_t total = 0;
+    for (int a = 0; a < NUM_ARRAYS; ++a) {
+        const Array array = (Array)a;
+        const bool is_samples = (array == Array::raw_samples) || (array == Array::processed_samples);
+        lengths[a] = (std::size_t)num_lines * (is_samples ? 2 : 1);
+        // Rounded up to whole cache lines, plus one. See the header.
+        strides[a] = (lengths[a] + per_line - 1) / per_line * per_line + per_line;
+        offsets[a] = total;
+        total += strides[a] * num_channels;
+    }
+    
+    floattype* raw = static_cast<floattype*>(::operator new[](std::max<std::size_t>(total, 1) * sizeof(floattype),
+                                                              std::align_val_t(ALIGNMENT)));
+    memory.reset(raw);
+    size = total;
+    clear();
+}
+
+std::span<floattype> ChunkArena::get(Array array, int channel)
+{
+    const int a = (int)array;
+    return std::span<floattype>(memory.get() + offsets[a] + strides[a] * channel, lengths[a]);
+}
+
+void ChunkArena::clear()
+{
+    std::fill(memory.get(), memory.get() + size, 0);
+}
+
+void ChunkArena::AlignedDelete::operator()(floattype* memory) const
+{
+    ::operator delete[](memory, std::align_val_t(ALIGNMENT));
+}
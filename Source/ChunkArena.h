@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ The per-line state of a set of ChunkProcessors (one per channel), all in one block of memory. Because the arena is made in prepare() at the largest size, EmpyModel::configure() can switch resolutions on the audio thread by clearing it and building new ChunkProcessors on it, without allocating. Each array gets a row per channel, and the rows of an array sit next to each other, so a pass over an array for every channel streams through one contiguous stretch of memory. Every row starts on an ALIGNMENT byte boundary, so no two rows share a cache line, and the loops over them can use aligned loads. Rows get one more cache line of padding than they need, so that they aren't a power of two apart: otherwise the same line of every row would land in the same cache set, and a pass that reads several arrays at once would keep evicting its own data.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "utils.h"
+
+class ChunkArena {
+public:
+    // A cache line, and as wide as any SIMD register we're likely to see.
+    static constexpr std::size_t ALIGNMENT = 64;
+    
+    // In the order the processing goes through them. The sample arrays are two
+    // hops long, the rest are a line each.
+    enum class Array {
+        raw_samples,
+        raw_freq_lines,
+        mean_values,
+        new_dynamic_thresh,
+        spread_demo,
+        threshold,
+        processed_freq_lines,
+        prev_processed_lines,
+        processed_samples
+    };
+    static constexpr int NUM_ARRAYS = 9;
+    
+    // A row as a ChunkProcessor holds it. Rows can be moved but not copied,
+    // and moving one leaves the original empty, so two processors can never
+    // end up writing to each other's lines.
+    class Row : public std::span<floattype> {
+    public:
+        Row() = default;
+        explicit Row(std::span<floattype> row) : std::span<floattype>(row) {}
+        Row(const Row&) = delete;
+        Row& operator=(const Row&) = delete;
+        Row(Row&& other) noexcept : std::span<floattype>(std::exchange(other.span(), {})) {}
+        Row& operator=(Row&& other) noexcept
+        {
+            if (this != &other) {
+                span() = std::exchange(other.span(), {});
+            }
+            return *this;
+        }
+        
+    private:
+        std::span<floattype>& span() { return *this; }
+    };
+    
+    ChunkArena();
+    ChunkArena(int num_channels, int num_lines);
+    
+    // A channel's row of one of the arrays. Everything starts at zero.
+    std::span<floattype> get(Array array, int channel);
+    // Sets everything back to zero.
+    void clear();
+    
+    int get_num_channels() const { return num_channels; }
+    int get_num_lines() const { return num_lines; }
+    
+private:
+    struct AlignedDelete {
+        void operator()(floattype* memory) const;
+    };
+    
+    std::unique_ptr<floattype[], AlignedDelete> memory;
+    int num_channels = 0;
+    int num_lines = 0;
+    std::size_t size = 0;
+    // Where each array starts, and how far apart its rows are, in floattypes.
+    std::array<std::size_t, NUM_ARRAYS> offsets {};
+    std::array<std::size_t, NUM_ARRAYS> strides {};
+    std::array<std::size_t, NUM_ARRAYS> lengths {};
+};
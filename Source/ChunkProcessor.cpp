@@ -23,42 +23,41 @@ template <typename T> int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
+StagePlan StagePlan::make(const floattype masking_amount,
+                          const floattype gate_ratio,
+                          const floattype bit_reduction_above_threshold)
+{
+    StagePlan plan;
+    plan.dynamic_threshold = (masking_amount != 0);
+    plan.gate = (gate_ratio != 1);
+    plan.quantize = (bit_reduction_above_threshold != 0);
+    return plan;
+}
+
 ChunkProcessor::ChunkProcessor()
 {
 }
 
-ChunkProcessor::ChunkProcessor(int lines, floattype fs)
+ChunkProcessor::ChunkProcessor(int lines, floattype fs, ChunkArena& arena, int channel)
 {
     sample_rate = fs;
     num_lines = lines;
     
-    raw_freq_lines = std::vector<floattype>(num_lines, 0.f);
-    processed_freq_lines = std::vector<floattype>(num_lines, 0.f);
-    prev_processed_lines = std::vector<floattype>(num_lines, 0.f);
-    
-    raw_samples = std::vector<floattype>(num_lines * 2, 0.f);
-    processed_samples = std::vector<floattype>(num_lines * 2, 0.f);
-        
-    energies = std::vector<floattype>(CRITICAL_BAND_CUTOFFS.size(), 0.f);
-    spread_energies = std::vector<floattype>(CRITICAL_BAND_CUTOFFS.size(), 0.f);
-    demo_spread_energies = std::vector<floattype>(CRITICAL_BAND_CUTOFFS.size(), 0.f);
-    
-    threshold = std::vector<floattype>(num_lines, 0.f);
-
-    absolute_threshold = std::vector<floattype>(num_lines);
-    band_assignments = std::vector<int>(num_lines);
-    lines_per_band = std::vector<int>(CRITICAL_BAND_CUTOFFS.size(),0.f);
-    
-    new_static_thresh = std::vector<floattype>(num_lines);
-    new_dynamic_thresh = std::vector<floattype>(num_lines);
-    spread_demo = std::vector<floattype>(num_lines);
+    // The arena can have room for more lines than we use.
+    const auto row = [&](ChunkArena::Array array, int length) {
+        return ChunkArena::Row(arena.get(array, channel).first(length));
+    };
+    raw_samples = row(ChunkArena::Array::raw_samples, num_lines * 2);
+    raw_freq_lines = row(ChunkArena::Array::raw_freq_lines, num_lines);
+    rms.mean_values = row(ChunkArena::Array::mean_values, num_lines);
+    new_dynamic_thresh = row(ChunkArena::Array::new_dynamic_thresh, num_lines);
+    spread_demo = row(ChunkArena::Array::spread_demo, num_lines);
+    threshold = row(ChunkArena::Array::threshold, num_lines);
+    processed_freq_lines = row(ChunkArena::Array::processed_freq_lines, num_lines);
+    prev_processed_lines = row(ChunkArena::Array::prev_processed_lines, num_lines);
+    processed_samples = row(ChunkArena::Array::processed_samples, num_lines * 2);
     
     assign_bands();
-    absoluteThreshold.fill_threshold(absolute_threshold, sample_rate);
-    
-    prev_abs_threshold_curve = -1;
-    prev_abs_threshold_level = -1;
-    
 }
 
 ChunkProcessor::~ChunkProcessor()
@@ -66,198 +65,348 @@ ChunkProcessor::~ChunkProcessor()
     ;
 }
 
-void ChunkProcessor::resize(int new_num_lines)
+std::vector<floattype> ChunkProcessor::build_spread_matrix(const std::vector<floattype> &kernel,
+                                                           const int kernel_center)
 {
-    num_lines = new_num_lines;
-    
-    raw_freq_lines.resize(num_lines, 0);
-    processed_freq_lines.resize(num_lines, 0);
-    prev_processed_lines = std::vector<floattype>(num_lines, 0.f);
-    
-    band_assignments.resize(num_lines);
-    threshold.resize(num_lines, 0);
-    absolute_threshold.resize(num_lines);
-    
-    new_static_thresh.resize(num_lines);
-    new_dynamic_thresh.resize(num_lines);
-    
-    raw_samples = std::vector<floattype>(num_lines * 2, 0.f);
-    processed_samples = std::vector<floattype>(num_lines * 2, 0.f);
-    
-    assign_bands();
-    absoluteThreshold.fill_threshold(absolute_threshold, sample_rate);
-    
+    std::vector<floattype> spread_matrix(NUM_BANDS * NUM_BANDS, 0);
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        for (int k = 0; k < (int)kernel.size(); ++k) {
+            const int out_band = b + k - kernel_center;
+            if ((0 <= out_band) && (out_band < NUM_BANDS)) {
+                spread_matrix[b * NUM_BANDS + out_band] = kernel[k];
+            }
+        }
+    }
+    return spread_matrix;
 }
 
-void ChunkProcessor::spread(const std::vector<floattype> &kernel,
-                            const int kernel_center)
+void ChunkProcessor::spread_bands(const std::vector<floattype> &spread_matrix,
+                                  std::vector<ChunkProcessor> &chunks)
 {
-    // Convolve spread kernel with energy to get spread energy
-    int out_index;
-    floattype src_energy;
-    for (int b = 0; b < CRITICAL_BAND_CUTOFFS.size(); ++b) {
-        src_energy = energies[b];
-        for (int k = 0; k < kernel.size(); ++k) {
-            out_index = b + k - kernel_center;
-            if ((0 <= out_index) && (out_index < CRITICAL_BAND_CUTOFFS.size())) {
-                spread_energies[out_index] += src_energy * kernel[k];
+    // Convolve spread kernel with energy to get spread energy, as a
+    // matrix-vector product per channel. Walking the matrix a row per input
+    // band, each row is loaded once for all the channels, and accumulates into
+    // a whole channel's output at once, which vectorizes.
+    for (auto& chunk : chunks) {
+        std::fill(chunk.spread_energies.begin(), chunk.spread_energies.end(), 0);
+    }
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        const floattype* row = &spread_matrix[b * NUM_BANDS];
+        for (auto& chunk : chunks) {
+            const floattype src_energy = chunk.energies[b];
+            floattype* out = &chunk.spread_energies[0];
+            for (int o = 0; o < NUM_BANDS; ++o) {
+                out[o] += row[o] * src_energy;
             }
         }
     }
 }
 
-void ChunkProcessor::make_spread_demo(const std::vector<floattype> &kernel,
-                                      const int kernel_center)
+void ChunkProcessor::build_spread_demo(const std::vector<floattype> &spread_matrix,
+                                       const floattype threshold_level)
 {
-    std::fill(demo_spread_energies.begin(), demo_spread_energies.end(), 0);
-    
-    const int demo_center = (int)CRITICAL_BAND_CUTOFFS.size() / 2;
+    // How the middle band alone spreads, turned into a threshold the same way
+    // as the real one.
+    const int demo_center = NUM_BANDS / 2;
+    const floattype* demo_row = &spread_matrix[demo_center * NUM_BANDS];
     const floattype src_energy = energies[demo_center];
-    
-    for (int k = 0; k < kernel.size(); ++k) {
-        demo_spread_energies[k - kernel_center + demo_center] = kernel[k] * src_energy;
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        std::fill(spread_demo.begin() + band_edges[b], spread_demo.begin() + band_edges[b + 1], demo_row[b] * src_energy * threshold_level);
     }
-}
-
-void ChunkProcessor::calc_static_thresh(const floattype abs_threshold_level,
-                                            const floattype perceptual_curve)
-{
+    const floattype* bias = &bias_curve->values[0];
     for (int f = 0; f < num_lines; ++f) {
-        // The choice of 60 doesn't have much mathematical backing, although it's probably not far off from the geometric mean of the
-        // threshold.... Honestly I'm not even sure if the geometric mean is the right sort of mean to take here, especially
-        // since both axes have log scales. But really, I chose a value that made changing the curve not mess with the
-        // threshold too much, when faced with the sort of frequency spectrum expected from musical sounds.
-        floattype a = std::pow(absolute_threshold[f], perceptual_curve) * std::pow((floattype)60, (1 - perceptual_curve));
-        new_static_thresh[f] = a * abs_threshold_level;
+        spread_demo[f] *= bias[f];
     }
 }
 
 void ChunkProcessor::calc_dynamic_thresh(const floattype masking_threshold_scalar)
 {
-    int band;
-    
-    for (int f = 0; f < num_lines; ++f) {
-        band = band_assignments[f];
-        new_dynamic_thresh[f] = spread_energies[band] * masking_threshold_scalar;
-        spread_demo[f] = demo_spread_energies[band] * masking_threshold_scalar;
+    // Every line in a band gets the band's threshold.
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        const auto first = band_edges[b];
+        const auto last = band_edges[b + 1];
+        std::fill(new_dynamic_thresh.begin() + first, new_dynamic_thresh.begin() + last, spread_energies[b] * masking_threshold_scalar);
     }
 }
 
-void ChunkProcessor::apply_bias_curve()
+void ChunkProcessor::track_levels(const floattype speed)
 {
-    for (int f = 0; f < num_lines; ++f) {
-        new_static_thresh[f] *= bias_curve[f];
-        new_dynamic_thresh[f] *= bias_curve[f];
-        spread_demo[f] *= bias_curve[f];
+    rms.set_decay_time(speed * sample_rate / (num_lines * 2));
+    rms.tick(raw_freq_lines);
+}
+
+void ChunkProcessor::analyze_bands(const BandReduction band_reduction)
+{
+    reduce_bands(band_reduction);
+}
+
+void ChunkProcessor::build_threshold(const floattype threshold_level, const StagePlan& plan)
+{
+    // The bias tilts both parts of the threshold. Without a dynamic threshold,
+    // the threshold is just the static one, so we don't need the max.
+    const floattype* static_thresh = &static_threshold->values[0];
+    const floattype* bias = &bias_curve->values[0];
+    if (plan.dynamic_threshold) {
+        calc_dynamic_thresh(threshold_level);
+        for (int f = 0; f < num_lines; ++f) {
+            new_dynamic_thresh[f] *= bias[f];
+            threshold[f] = std::max(static_thresh[f] * bias[f], new_dynamic_thresh[f]);
+        }
+    } else {
+        std::fill(new_dynamic_thresh.begin(), new_dynamic_thresh.end(), 0);
+        for (int f = 0; f < num_lines; ++f) {
+            threshold[f] = static_thresh[f] * bias[f];
+        }
     }
 }
 
-void ChunkProcessor::build_threshold(const std::vector<floattype> &kernel,
-                                     const int kernel_center,
-                                     const floattype threshold_level,
-                                     const floattype abs_threshold_level,
-                                     const floattype speed,
-                                     const floattype perceptual_curve)
+// The log2-domain maths for the gate and quantization. The approximations in
+// FastMath.h are only good to single precision, so the double build uses the
+// standard library instead, with the same clamps at the bottom of the range,
+// and keeps the precision of its lines.
+#if USE_DOUBLE
+using LineBits = std::int64_t;
+
+static inline floattype line_log2(const floattype x)
 {
-    rms.set_decay_time(speed * sample_rate / (num_lines * 2));
-    rms.tick(raw_freq_lines);
-    
-    std::fill(spread_energies.begin(), spread_energies.end(), 0);
+    return std::log2(std::max(x, std::numeric_limits<floattype>::min()));
+}
 
-    for (int f = 0; f < num_lines; ++f) {
-        energies[band_assignments[f]] = rms.mean_values[f];
+static inline floattype line_exp2(const floattype x)
+{
+    return std::exp2(std::max(x, (floattype)(std::numeric_limits<floattype>::min_exponent - 1)));
+}
+
+static inline floattype line_floor(const floattype x)
+{
+    return std::floor(x);
+}
+
+static inline floattype line_min_zero(const floattype x)
+{
+    return std::min(x, (floattype)0);
+}
+#else
+using LineBits = std::int32_t;
+
+static inline floattype line_log2(const floattype x)
+{
+    return fast_log2(x);
+}
+
+static inline floattype line_exp2(const floattype x)
+{
+    return fast_exp2(x);
+}
+
+static inline floattype line_floor(const floattype x)
+{
+    return fast_floor(x);
+}
+
+static inline floattype line_min_zero(const floattype x)
+{
+    return fast_min_zero(x);
+}
+#endif
+
+// The gate's gain for a line, in log2 units (1 = 6.02 dB), given the line's
+// level (the log2 of its amplitude). See apply_threshold().
+static inline floattype gate_gain(const floattype level,
+                                  const floattype thresh,
+                                  const floattype mean,
+                                  const floattype gate_slope)
+{
+    // The threshold is a power, so half its log2 is the amplitude level.
+    const floattype thresh_level = (floattype)0.5 * line_log2(thresh);
+    const LineBits gated = -(LineBits)((thresh > mean) & (mean != 0) & (thresh != 0));
+    return std::bit_cast<floattype>(gated & std::bit_cast<LineBits>(gate_slope * line_min_zero(level - thresh_level)));
+}
+
+void ChunkProcessor::link_lines(const std::vector<ChunkProcessor> &chunks, const bool sum)
+{
+    // The RMS squares the lines, so for the sum we add up their squares and
+    // take the root.
+    floattype* linked = raw_freq_lines.data();
+    std::fill(raw_freq_lines.begin(), raw_freq_lines.end(), 0);
+    for (const auto& chunk : chunks) {
+        const floattype* raw = chunk.raw_freq_lines.data();
+        if (sum) {
+            for (int f = 0; f < num_lines; ++f) {
+                linked[f] += raw[f] * raw[f];
+            }
+        } else {
+            for (int f = 0; f < num_lines; ++f) {
+                linked[f] = std::max(linked[f], std::abs(raw[f]));
+            }
+        }
     }
-    
-    spread(kernel, kernel_center);
-    make_spread_demo(kernel, kernel_center);
+    if (sum) {
+        for (int f = 0; f < num_lines; ++f) {
+            linked[f] = std::sqrt(linked[f]);
+        }
+    }
+}
+
+void ChunkProcessor::apply_threshold(const floattype bit_reduction_above_threshold,
+                                     const floattype gate_ratio,
+                                     const StagePlan& plan)
+{
+    apply_threshold(bit_reduction_above_threshold, gate_ratio, plan, *this);
+}
 
-    floattype masking_threshold_scalar = threshold_level;
+void ChunkProcessor::apply_threshold(const floattype bit_reduction_above_threshold,
+                                     const floattype gate_ratio,
+                                     const StagePlan& plan,
+                                     const ChunkProcessor& levels)
+{
+    // The gate and the quantization only ever change the size of a line, never
+    // its sign, so we work out what they do in log2 units:
+    //  - Where the threshold is above the line's average level (and neither of
+    //    them is zero), every dB the line is below the threshold becomes
+    //    gate_ratio dB. That's a gain of (gate_ratio - 1) * (level - threshold
+    //    level), when the line is below the threshold, and 0 when it isn't.
+    //  - The quantization rounds the gated level down to a whole number of
+    //    steps of bit_reduction_above_threshold dB.
+    // The conditions are turned into bit masks rather than branches, and in
+    // the float build the log2 and exp2 are the approximations from
+    // FastMath.h, so both loops vectorize. They're accurate to well under
+    // 1e-5 dB. The double build uses std::log2 and std::exp2.
+    const floattype gate_slope = gate_ratio - 1;
     
-    if ((abs_threshold_level != prev_abs_threshold_level) ||
-        (perceptual_curve != prev_abs_threshold_curve)) {
-        calc_static_thresh(abs_threshold_level, perceptual_curve);
+    if (plan.quantize) {
+        if (plan.gate) {
+            quantize_lines<true>(bit_reduction_above_threshold, gate_slope, levels);
+        } else {
+            quantize_lines<false>(bit_reduction_above_threshold, gate_slope, levels);
+        }
+        return;
     }
     
-    calc_dynamic_thresh(masking_threshold_scalar);
-    
-    apply_bias_curve();
+    // Without the gate, the gain is 0, and 2^0 is exactly 1, so the lines
+    // would come out as they went in.
+    if (not plan.gate) {
+        std::copy(raw_freq_lines.begin(), raw_freq_lines.end(), processed_freq_lines.begin());
+        return;
+    }
     
+    const floattype* raw = &raw_freq_lines[0];
+    const floattype* thresh = &levels.threshold[0];
+    const floattype* mean = &levels.rms.mean_values[0];
+    floattype* processed = &processed_freq_lines[0];
     for (int f = 0; f < num_lines; ++f) {
-        threshold[f] = std::max(new_static_thresh[f], new_dynamic_thresh[f]);
+        const floattype level = line_log2(std::abs(raw[f]));
+        processed[f] = raw[f] * line_exp2(gate_gain(level, thresh[f], mean[f], gate_slope));
     }
-    
 }
 
-void ChunkProcessor::apply_threshold(const floattype bit_reduction_above_threshold,
-                                     const floattype gate_ratio)
+template <bool gated>
+void ChunkProcessor::quantize_lines(const floattype bit_reduction_above_threshold,
+                                    const floattype gate_slope,
+                                    const ChunkProcessor& levels)
 {
-    
-    floattype raw, thresh, processed;
+    // The quantizer snaps each line to the grid: the magnitude is built from
+    // the grid level alone (exp2 puts the whole part straight into the
+    // exponent bits), and the sign bit is copied over from the line. So every
+    // line that lands on the same step comes out at exactly the same
+    // magnitude, and a silent line stays silent. Steps finer than
+    // MIN_QUANTIZATION_STEP dB are far too fine to hear, and rounding them up
+    // keeps the number of steps in range for fast_floor().
+    const floattype DB_PER_OCTAVE = (floattype)6.020599913279624; // 20 log10(2)
+    const floattype MIN_QUANTIZATION_STEP = (floattype)0.001;
+    const floattype step = std::max(bit_reduction_above_threshold, MIN_QUANTIZATION_STEP) / DB_PER_OCTAVE;
+    const floattype inverse_step = 1 / step;
+    const LineBits SIGN_BIT = std::numeric_limits<LineBits>::min();
+    const floattype* raw = &raw_freq_lines[0];
+    const floattype* thresh = &levels.threshold[0];
+    const floattype* mean = &levels.rms.mean_values[0];
+    floattype* processed = &processed_freq_lines[0];
     for (int f = 0; f < num_lines; ++f) {
-        
-        raw = raw_freq_lines[f];
-        thresh = threshold[f];
-        
-        processed = raw;
-        if ((thresh > rms.mean_values[f]) && (rms.mean_values[f] != 0.0) && (thresh != 0.0)) {
-            floattype db_thresh = power_to_db(thresh);
-            floattype db_from_thresh = power_to_db(raw * raw) - db_thresh;
-            if (db_from_thresh < 0) {
-                db_from_thresh *= gate_ratio;
-            }
-            
-            processed = db_to_amplitude(db_from_thresh + db_thresh);
-            if (raw < 0) {
-                processed = -processed;
-            }
-        }
-        if ((bit_reduction_above_threshold != 0) && (processed != 0)) {
-            floattype p = db_to_amplitude(std::floor(amplitude_to_db(processed) / bit_reduction_above_threshold) * bit_reduction_above_threshold);
-            if (processed < 0) {
-                processed = -p;
-            } else {
-                processed = p;
-            }
+        const floattype line = raw[f];
+        const floattype level = line_log2(std::abs(line));
+        floattype gated_level = level;
+        if constexpr (gated) {
+            gated_level += gate_gain(level, thresh[f], mean[f], gate_slope);
         }
-        processed_freq_lines[f] = processed;
+        const floattype grid_level = line_floor(gated_level * inverse_step) * step;
         
+        const LineBits line_bits = std::bit_cast<LineBits>(line);
+        const LineBits magnitude_bits = std::bit_cast<LineBits>(line_exp2(grid_level));
+        const LineBits nonzero = -(LineBits)(line != 0);
+        processed[f] = std::bit_cast<floattype>((magnitude_bits | (line_bits & SIGN_BIT)) & nonzero);
     }
-    
 }
 
 void ChunkProcessor::assign_bands()
 {
-    // Calculate which critical band each frequency line should be in.
-    // TODO: doesn't this result in nothing being in band 0, and 2 bands being crammed
-    // into the top band? i.e. off-by-one error.
-    
-    int band = 0;
-    floattype freq;
-    std::fill(lines_per_band.begin(),lines_per_band.end(),0);
-    
-    for (int f = 0; f < num_lines; ++f) {
-        freq = line_to_freq((floattype)f);
-        if ((freq > CRITICAL_BAND_CUTOFFS[band]) && (band < CRITICAL_BAND_CUTOFFS.size() - 1)) {
-            ++band;
+    // Calculate which lines each critical band covers. Band b starts at the
+    // first line at or above CRITICAL_BAND_CUTOFFS[b], and runs up to the start
+    // of the next band. The last band runs to the top line, wherever the
+    // Nyquist frequency falls, so every line is in a band.
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        const int first = (int)std::ceil(freq_to_line(CRITICAL_BAND_CUTOFFS[b]));
+        band_edges[b] = std::clamp(first, 0, num_lines);
+    }
+    band_edges[NUM_BANDS] = num_lines;
+}
+
+void ChunkProcessor::reduce_bands(const BandReduction band_reduction)
+{
+    // Each band's lines are next to each other, so this is one straight pass
+    // over the line averages. An empty band has no energy.
+    const floattype* values = rms.mean_values.data();
+    for (int b = 0; b < NUM_BANDS; ++b) {
+        const floattype* first = values + band_edges[b];
+        const floattype* last = values + band_edges[b + 1];
+        const int count = band_edges[b + 1] - band_edges[b];
+        if (count == 0) {
+            energies[b] = 0;
+            continue;
+        }
+        switch (band_reduction) {
+            case BandReduction::sum:
+                energies[b] = std::reduce(first, last, (floattype)0);
+                break;
+            case BandReduction::max:
+                energies[b] = *std::max_element(first, last);
+                break;
+            case BandReduction::mean:
+            default:
+                energies[b] = std::reduce(first, last, (floattype)0) / count;
+                break;
         }
-        band_assignments[f] = band;
-        lines_per_band[band]++;
     }
 }
 
 void ChunkProcessor::recover_packet()
 {
-    // Use the absolute values of the most recent packet but the magnitudes of the last transmitted packet.
+    // Use the signs of the most recent packet but the magnitudes of the last
+    // transmitted packet. The threshold never changes a line's sign, so the
+    // signs are taken straight from the raw lines, and the packet doesn't need
+    // processing. Where the most recent line is zero, it has no sign to give,
+    // so the old line is kept as it was. This is a copysign, with the zero
+    // check folded in, done on the bits so that it vectorizes.
+    using Bits = std::conditional_t<sizeof(floattype) == 8, std::uint64_t, std::uint32_t>;
+    constexpr Bits SIGN = Bits(1) << (sizeof(Bits) * 8 - 1);
+    const floattype* raw = raw_freq_lines.data();
+    const floattype* prev = prev_processed_lines.data();
+    floattype* processed = processed_freq_lines.data();
     for (int t = 0; t < num_lines; ++t) {
-        if (((processed_freq_lines[t] > 0) && (prev_processed_lines[t] < 0)) ||
-            ((processed_freq_lines[t] < 0) && (prev_processed_lines[t] > 0))) {
-            processed_freq_lines[t] = -prev_processed_lines[t];
-        } else {
-            processed_freq_lines[t] = prev_processed_lines[t];
-        }
+        const Bits new_bits = std::bit_cast<Bits>(raw[t]);
+        const Bits old_bits = std::bit_cast<Bits>(prev[t]);
+        const Bits nonzero = -(Bits)((new_bits & ~SIGN) != 0);
+        const Bits sign = ((new_bits & nonzero) | (old_bits & ~nonzero)) & SIGN;
+        processed[t] = std::bit_cast<floattype>((old_bits & ~SIGN) | sign);
     }
 }
 
+void ChunkProcessor::keep_frame()
+{
+    // The next frame is written over whatever's in processed_freq_lines, so
+    // swapping is as good as copying.
+    std::swap(processed_freq_lines, prev_processed_lines);
+}
+
 floattype ChunkProcessor::freq_to_line(floattype freq)
 {
     return num_lines * freq / (sample_rate / 2);
@@ -268,31 +417,6 @@ floattype ChunkProcessor::line_to_freq(floattype line)
     return line * (sample_rate / 2) / num_lines;
 }
 
-void ChunkProcessor::build_bias(floattype new_bias)
-{
-    bias_curve.resize(num_lines);
-    floattype left = freq_to_line(60);
-    floattype right = freq_to_line(20000);
-    const floattype PI = 3.14159265359;
-    
-    // DUCK: by lowering the threshold when the bias is in the middle, we keep the overall threshold low-point
-    // about the same at all bias settings, so that audio doesn't come in and out wildly when the bias is changed.
-    // This way, users can change the sound with the bias slider alone, without having to move the threshold level
-    // sliders simultaneously.
-    floattype duck = std::cos(new_bias * PI / 4.0);
-    const floattype duck_amount = -2.0;
-    const floattype sharpness = 5;
-    floattype input, rawcurve;
-    for (int f = 0; f < num_lines; ++f) {
-        // Input rescales left -- right to a log scale between 0 and 1.
-        input = std::log((floattype) f / left) / std::log(right / left);
-        rawcurve = (atan((input - 0.5) * sharpness) / PI) * 6 * (-new_bias);
-        bias_curve[f] = std::pow(10.0, rawcurve + duck * duck_amount);
-        // bias_curve[f] = std::max(((atan((input - 0.5) * sharpness) / PI) * 2 * (-new_bias) + 1) / 2, 0.0);
-    }
-}
-
-
 floattype amplitude_to_db(const floattype amplitude)
 {
     return 20.0 * std::log10(std::abs(amplitude));
@@ -27,9 +27,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <array>
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <type_traits>
 
-#include "AbsoluteThreshold.h"
+#include "BiasCurve.h"
+#include "ChunkArena.h"
+#include "FastMath.h"
 #include "RootMeanSquare.h"
+#include "StaticThreshold.h"
 #include "utils.h"
 
 floattype amplitude_to_db(const floattype amplitude);
@@ -37,48 +44,124 @@ floattype power_to_db(const floattype power);
 floattype db_to_amplitude(const floattype db);
 floattype db_to_power(const floattype db);
 
+// How the lines in a critical band are combined into the band's energy, before
+// it's spread to the other bands.
+enum class BandReduction {
+    sum,
+    mean,
+    max
+};
+
+// Which stages of the threshold have anything to do, with the current
+// settings. A stage that would leave every line as it is gets skipped, which
+// never changes the output. EmpyModel makes a new plan whenever one of the
+// settings it depends on changes.
+struct StagePlan {
+    // The dynamic threshold is zero when there's no masking. The static one
+    // is always there: the bottom of its slider is a level of 1e-22, which
+    // some of the quietest lines are still under, so it's never skipped.
+    bool dynamic_threshold = false;
+    // So there's always a threshold, and the gate only does nothing at a
+    // ratio of 1.
+    bool gate = false;
+    bool quantize = false;
+    
+    static StagePlan make(const floattype masking_amount,
+                          const floattype gate_ratio,
+                          const floattype bit_reduction_above_threshold);
+};
+
 class ChunkProcessor {
 public:
+    static constexpr int NUM_BANDS = 25;
+    
+    // An empty processor, with no lines, to be replaced with a real one.
     ChunkProcessor();
-    ChunkProcessor(int lines, floattype fs);
+    // Keeps the per-line state in the channel's rows of the arena, which must
+    // have (at least) lines lines. Only one processor can hold a row at once,
+    // so processors can be moved but not copied.
+    ChunkProcessor(int lines, floattype fs, ChunkArena& arena, int channel);
     ~ChunkProcessor();
-    
-    void resize(int new_num_lines);
-    void build_threshold(const std::vector<floattype> &kernel,
-                         const int kernel_center,
-                         const floattype threshold_level,
-                         const floattype abs_threshold_level,
-                         const floattype speed,
-                         const floattype perceptual_curve);
-    
+    ChunkProcessor(ChunkProcessor&&) = default;
+    ChunkProcessor& operator=(ChunkProcessor&&) = default;
+    
+    // Keeps the average level of each line up to date. It has to see every
+    // frame, even when nothing uses the averages, so they're right as soon as
+    // something does.
+    void track_levels(const floattype speed);
+    // The threshold is built in three steps, so that the middle one can be done
+    // for every channel at once: analyze_bands() measures the energy in each
+    // critical band, spread_bands() spreads it to the neighbouring bands, and
+    // build_threshold() turns the result into a threshold for each line. The
+    // first two are only needed when the plan has a dynamic threshold.
+    void analyze_bands(const BandReduction band_reduction = BandReduction::mean);
+    static void spread_bands(const std::vector<floattype> &spread_matrix,
+                             std::vector<ChunkProcessor> &chunks);
+    void build_threshold(const floattype threshold_level, const StagePlan& plan);
+    // Only for the graph: fills spread_demo with what the threshold would be
+    // if only the middle band had any energy. Call it after spread_bands().
+    void build_spread_demo(const std::vector<floattype> &spread_matrix,
+                           const floattype threshold_level);
+    
+    // The spreading as a NUM_BANDS x NUM_BANDS (25 x 25) matrix, for
+    // spread_bands(). Row b holds what band b spreads to each band, i.e. the
+    // kernel, centered on b and cut off at the edges.
+    static std::vector<floattype> build_spread_matrix(const std::vector<floattype> &kernel,
+                                                      const int kernel_center);
+    
+    // Gates and quantizes the lines against the threshold and average levels
+    // of levels, which is this chunk, unless the channels are linked.
     void apply_threshold(const floattype bit_reduction_above_threshold,
-                         const floattype gate_ratio);
+                         const floattype gate_ratio,
+                         const StagePlan& plan);
+    void apply_threshold(const floattype bit_reduction_above_threshold,
+                         const floattype gate_ratio,
+                         const StagePlan& plan,
+                         const ChunkProcessor& levels);
+    // For linking channels: fills raw_freq_lines with the loudest of the
+    // chunks' lines, or, with sum, lines with the chunks' total power, so the
+    // threshold worked out from them can be shared by all the chunks.
+    void link_lines(const std::vector<ChunkProcessor> &chunks, const bool sum);
     void calc_graph_lines();
+    // Fills processed_freq_lines with the last frame that got through, in
+    // place of apply_threshold(). Only needs the raw lines.
     void recover_packet();
+    // Makes this frame's processed lines the ones recover_packet() uses, by
+    // swapping them with the previous frame's. Call it once the processed
+    // lines have been used, as they're left holding the previous frame's.
+    void keep_frame();
     
-    std::vector<floattype> threshold;
-    
-    std::vector<floattype> raw_freq_lines;
-    std::vector<floattype> processed_freq_lines;
-    std::vector<floattype> prev_processed_lines;
-
+    // Which lines each critical band covers: band b is lines edges[b] up to
+    // (not including) edges[b + 1].
+    const std::array<int, NUM_BANDS + 1>& get_band_edges() const { return band_edges; }
     
-    std::vector<floattype> raw_samples;
-    std::vector<floattype> processed_samples;
+    // These all live in a ChunkArena, shared with the other channels.
+    ChunkArena::Row threshold;
     
-    std::vector<floattype> new_static_thresh;
-    std::vector<floattype> new_dynamic_thresh;
+    ChunkArena::Row raw_freq_lines;
+    ChunkArena::Row processed_freq_lines;
+    ChunkArena::Row prev_processed_lines;
+
     
-    std::vector<floattype> spread_demo;
+    ChunkArena::Row raw_samples;
+    ChunkArena::Row processed_samples;
     
-    int num_lines;
+    // Shared with the other channels. Set by EmpyModel whenever the settings
+    // they depend on change.
+    std::shared_ptr<const StaticThreshold> static_threshold;
+    std::shared_ptr<const BiasCurve> bias_curve;
+    ChunkArena::Row new_dynamic_thresh;
     
-    std::vector<floattype> bias_curve;
+    ChunkArena::Row spread_demo;
     
-    void build_bias(floattype new_bias);
+    int num_lines = 0;
     
 private:
-    std::array<floattype, 26> CRITICAL_BAND_CUTOFFS = {
+    // The edges of the critical bands, in Hz: band b runs from
+    // CRITICAL_BAND_CUTOFFS[b] up to CRITICAL_BAND_CUTOFFS[b + 1]. The top edge
+    // is above the Nyquist frequency at the usual sample rates, so the last
+    // band just runs to the top line.
+    std::array<floattype, NUM_BANDS + 1> CRITICAL_BAND_CUTOFFS = {
         0,
         100,
         200,
@@ -107,38 +190,27 @@ private:
         25000
     };
 
-    std::vector<floattype> absolute_threshold;
-    
-    
-    std::vector<floattype> energies;
-    std::vector<floattype> spread_energies;
-    std::vector<floattype> demo_spread_energies;
+
+    std::array<floattype, NUM_BANDS> energies {};
+    std::array<floattype, NUM_BANDS> spread_energies {};
     
-    std::vector<int> band_assignments;
-    std::vector<int> lines_per_band;
+    // Band b is lines band_edges[b] up to (not including) band_edges[b + 1].
+    // Bands above the Nyquist frequency, or too narrow to have a line of their
+    // own at low resolutions, are empty.
+    std::array<int, NUM_BANDS + 1> band_edges {};
     
     void assign_bands();
-    void spread(const std::vector<floattype> &kernel,
-                const int kernel_center);
-    void calc_static_thresh(const floattype abs_threshold_level,
-                            const floattype perceptual_curve);
+    void reduce_bands(const BandReduction band_reduction);
     void calc_dynamic_thresh(const floattype masking_threshold_scalar);
-    void apply_bias_curve();
-    
-    void fill_absolute_threshold();
-    
-    void make_spread_demo(const std::vector<floattype> &kernel,
-                          const int kernel_center);
+    template <bool gated>
+    void quantize_lines(const floattype bit_reduction_above_threshold,
+                        const floattype gate_slope,
+                        const ChunkProcessor& levels);
     
     floattype sample_rate;
     
     floattype freq_to_line(floattype freq);
     floattype line_to_freq(floattype line);
     
-    floattype prev_abs_threshold_level;
-    floattype prev_abs_threshold_curve;
-    
-    AbsoluteThreshold absoluteThreshold;
-    
     RootMeanSquare rms;
 };
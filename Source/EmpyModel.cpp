@@ -18,6 +18,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "EmpyModel.h"
 
 
+// Block switching needs at least this many lines, so that the short frames
+// have at least 8.
+static const int MIN_SWITCHING_LINES = 64;
+// A sub-block is a transient if its energy is this many times the recent
+// average (10 dB), and louder than the floor (per sample), so that we don't
+// trigger on noise coming out of silence.
+static const floattype TRANSIENT_RATIO = 10.0;
+static const floattype TRANSIENT_FLOOR = 1e-5;
+// How quickly the average follows the energy, per sub-block.
+static const floattype TRANSIENT_AVERAGE_SPEED = 0.25;
+
 floattype decibel(floattype sample)
 {
     return std::log10(sample * sample) * 10.0f;
@@ -36,66 +47,421 @@ void EmpyModel::set_control_parameters(std::array<ControlParameter, NUM_CONTROL_
 
 void EmpyModel::prepare(int mdct_step, floattype sample_rate, int n_channels)
 {
+    // Everything that depends on the resolution or the window is made (or
+    // made room for) here, for all of them, so that changing them while we
+    // play only has to pick out the right parts. See configure().
+    const std::lock_guard<std::mutex> guard(table_lock);
     num_channels = n_channels;
+    SAMPLE_RATE = sample_rate;
+    
+    // Mid/side needs a stereo pair. Everything's cleared below, so there's
+    // nothing to convert.
+    if ((num_channels != 2) && (stereo_mode == StereoMode::mid_side)) {
+        stereo_mode = StereoMode::separate;
+    }
+    
+    chunk_processors.resize(num_channels);
+    chunk_arena = ChunkArena(num_channels, MAX_MDCT_LINES);
+    short_chunk_processors.resize(num_channels);
+    short_chunk_arena = ChunkArena(num_channels, MAX_MDCT_LINES / MdctPlan::SHORT_FRAMES);
+    link_processors.resize(1);
+    link_arena = ChunkArena(1, MAX_MDCT_LINES);
+    short_link_processors.resize(1);
+    short_link_arena = ChunkArena(1, MAX_MDCT_LINES / MdctPlan::SHORT_FRAMES);
+    
+    graphScaledLines.reserve(MAX_MDCT_LINES);
+    
+    // The short frames cover SHORT_FRAMES + 1 short hops, and the lookahead is
+    // half a long hop.
+    const int max_short_span = MAX_MDCT_LINES / MdctPlan::SHORT_FRAMES * (MdctPlan::SHORT_FRAMES + 1);
+    short_inputs.resize(num_channels);
+    short_outputs.resize(num_channels);
+    lookahead.resize(num_channels);
+    for (int c = 0; c < num_channels; ++c) {
+        short_inputs[c].reserve(max_short_span);
+        short_outputs[c].reserve(max_short_span);
+        lookahead[c].reserve(MAX_MDCT_LINES / 2);
+    }
+    transient_prev_sample.resize(num_channels);
+    transient_energy.resize(num_channels);
+    transient_average.resize(num_channels);
+    
+    raw_sample_channels.resize(num_channels);
+    raw_freq_channels.resize(num_channels);
+    processed_sample_channels.resize(num_channels);
+    processed_freq_channels.resize(num_channels);
+    channel_samples.resize(num_channels);
+    
+    // Every resolution's static threshold, for the settings we've got so far,
+    // and its bias curve for every bias. configure() hands them out.
+    fresh_tables_ready.store(false, std::memory_order_relaxed);
+    fetch_tables(tables, table_settings());
+    fresh_version = settings_version.load(std::memory_order_relaxed);
+    for (int lines = MIN_MDCT_LINES; lines <= MAX_MDCT_LINES; lines *= 2) {
+        std::vector<std::shared_ptr<const BiasCurve>>& curves = bias_curves[resolution_index(lines)];
+        curves.resize(BiasCurve::NUM_STEPS);
+        for (int step = 0; step < BiasCurve::NUM_STEPS; ++step) {
+            curves[step] = BiasCurve::get(lines, SAMPLE_RATE, BiasCurve::step_bias(step));
+        }
+    }
     
-    // Forces set bias
-    bias = 2;
+    build_transforms();
+    configure(mdct_step);
+}
+
+void EmpyModel::build_transforms()
+{
+    // A set of transforms for each window and resolution, so that changing
+    // either while we play only has to pick out a different set. The ones for
+    // block switching are made whether it's on or not, for the same reason.
+    // The plans
+    // (the windows and twiddles) are shared with any other instances that use
+    // them, and we only ever run one transform at a time, so they all work in
+    // the same scratch space.
+    transform_scratch = std::make_shared<MdctScratch>();
+    for (int s = 0; s < NUM_WINDOW_SHAPES; ++s) {
+        const WindowShape shape = (WindowShape)s;
+        for (int lines = MIN_MDCT_LINES; lines <= MAX_MDCT_LINES; lines *= 2) {
+            FrameTransforms& set = transforms[s][resolution_index(lines)];
+            const int width = lines * 2;
+            const FourierBackend backend = TransformTuner::get_backend(width);
+            set.plain = std::make_unique<ModifiedDiscreteCosineTransform>(width, num_channels, backend, shape,
+                                                                          WindowTransition::none, transform_scratch);
+            if ((lines >= MIN_SWITCHING_LINES) && (shape != WindowShape::low_overlap)) {
+                set.start = std::make_unique<ModifiedDiscreteCosineTransform>(width, num_channels, backend, shape,
+                                                                              WindowTransition::start, transform_scratch);
+                set.stop = std::make_unique<ModifiedDiscreteCosineTransform>(width, num_channels, backend, shape,
+                                                                             WindowTransition::stop, transform_scratch);
+                set.start_stop = std::make_unique<ModifiedDiscreteCosineTransform>(width, num_channels, backend, shape,
+                                                                                   WindowTransition::start_stop, transform_scratch);
+                const int short_width = width / MdctPlan::SHORT_FRAMES;
+                set.short_frames = std::make_unique<ModifiedDiscreteCosineTransform>(short_width, num_channels,
+                                                                                     TransformTuner::get_backend(short_width),
+                                                                                     shape, WindowTransition::none, transform_scratch);
+            } else {
+                set.start.reset();
+                set.stop.reset();
+                set.start_stop.reset();
+                set.short_frames.reset();
+            }
+        }
+    }
+}
+
+void EmpyModel::configure(int mdct_step)
+{
+    // Switches to a new resolution, using only what prepare() made, so this
+    // never allocates: the vectors it resizes already have the room.
+    if ((not isPowerOfTwo(mdct_step)) || (mdct_step < MIN_MDCT_LINES) || (mdct_step > MAX_MDCT_LINES)) {
+        throw std::invalid_argument("MDCT step size must be a power of 2, from 4 to 4096");
+    }
     MDCT_WIDTH = mdct_step * 2;
     MDCT_LINES = mdct_step;
-    SAMPLE_RATE = sample_rate;
     
-    if (not isPowerOfTwo(mdct_step)) {
-        throw std::invalid_argument("MDCT step size must be a power of 2");
+    chunk_arena.clear();
+    for (int c = 0; c < num_channels; ++c) {
+        chunk_processors[c] = ChunkProcessor(MDCT_LINES, SAMPLE_RATE, chunk_arena, c);
     }
-    // We do this in 2 lines (resize and then fill) because we want to call the constructor
-    // with the new number of lines and sample rate for all the items.
-    chunk_processors.resize(num_channels);
-    std::fill(chunk_processors.begin(), chunk_processors.end(), ChunkProcessor(MDCT_LINES, SAMPLE_RATE));
+    link_arena.clear();
+    link_processors[0] = ChunkProcessor(MDCT_LINES, SAMPLE_RATE, link_arena, 0);
     
     graphScaledLines.resize(MDCT_LINES);
-
-    mdct = std::make_unique<ModifiedDiscreteCosineTransform>(MDCT_WIDTH);
+    
+    const FrameTransforms& set = transforms[(int)window_shape][resolution_index(MDCT_LINES)];
+    mdct = set.plain.get();
+    window_zeros = mdct->get_window_zeros();
+    
+    switching_active = block_switching && (set.short_frames != nullptr);
+    start_mdct = set.start.get();
+    stop_mdct = set.stop.get();
+    start_stop_mdct = set.start_stop.get();
+    short_mdct = set.short_frames.get();
+    if (switching_active) {
+        const int short_lines = MDCT_LINES / MdctPlan::SHORT_FRAMES;
+        short_chunk_arena.clear();
+        for (int c = 0; c < num_channels; ++c) {
+            short_chunk_processors[c] = ChunkProcessor(short_lines, SAMPLE_RATE, short_chunk_arena, c);
+        }
+        short_link_arena.clear();
+        short_link_processors[0] = ChunkProcessor(short_lines, SAMPLE_RATE, short_link_arena, 0);
+        
+        subblock_len = short_lines;
+        lookahead_len = MDCT_LINES / 2;
+        for (int c = 0; c < num_channels; ++c) {
+            short_inputs[c].assign(subblock_len * (MdctPlan::SHORT_FRAMES + 1), 0);
+            short_outputs[c].assign(subblock_len * (MdctPlan::SHORT_FRAMES + 1), 0);
+            lookahead[c].assign(lookahead_len, 0);
+        }
+        std::fill(transient_prev_sample.begin(), transient_prev_sample.end(), 0);
+        std::fill(transient_energy.begin(), transient_energy.end(), 0);
+        std::fill(transient_average.begin(), transient_average.end(), 0);
+    } else {
+        lookahead_len = 0;
+    }
+    lookahead_index = 0;
+    subblock_fill = 0;
+    transient_countdown = 0;
+    previous_short = false;
+    current_short = false;
+    
+    // The hop transforms take each channel's buffers by pointer. These stay
+    // valid until the next configure().
+    for (int c = 0; c < num_channels; ++c) {
+        raw_sample_channels[c] = chunk_processors[c].raw_samples.data();
+        raw_freq_channels[c] = chunk_processors[c].raw_freq_lines.data();
+        processed_sample_channels[c] = chunk_processors[c].processed_samples.data();
+        processed_freq_channels[c] = chunk_processors[c].processed_freq_lines.data();
+    }
     
     // The block index tracks the position of the start of the input/output
     // mdct buffers. It's kinda arbitrary where we initialize it.
     block_index = 0;
     
     in_loss_state = false;
+    
+    share_tables();
 }
 
 void EmpyModel::process(int start_pos)
 {
     // Does all the processing we need to do, and adds the result to the output.
     
+    // The transient detector has just finished looking at the middle of the
+    // next frame, so this is where we decide whether it'll be short, which
+    // decides the window for this one.
+    const bool next_short = switching_active && (transient_countdown > 0);
+    if (current_short) {
+        process_short(start_pos);
+    } else if (previous_short && next_short) {
+        process_long(start_pos, WindowTransition::start_stop);
+    } else if (previous_short) {
+        process_long(start_pos, WindowTransition::stop);
+    } else if (next_short) {
+        process_long(start_pos, WindowTransition::start);
+    } else {
+        process_long(start_pos, WindowTransition::none);
+    }
+    previous_short = current_short;
+    current_short = next_short;
+}
+
+void EmpyModel::process_long(int start_pos, WindowTransition transition)
+{
+    ModifiedDiscreteCosineTransform* frame_mdct;
+    switch (transition) {
+        case WindowTransition::start:
+            frame_mdct = start_mdct;
+            break;
+        case WindowTransition::stop:
+            frame_mdct = stop_mdct;
+            break;
+        case WindowTransition::start_stop:
+            frame_mdct = start_stop_mdct;
+            break;
+        case WindowTransition::none:
+        default:
+            frame_mdct = mdct;
+            break;
+    }
+    
+    // The graph's lines are only worth working out if someone's looking.
+    const bool graphing = graph_requested.load(std::memory_order_acquire);
+    const GraphOverlay overlay = graph_overlay.load(std::memory_order_relaxed);
+    
+    frame_mdct->transform_hop(raw_sample_channels, raw_freq_channels, start_pos);
+    
+    in_loss_state = lossModel.tick();
+    const bool stuck = is_stuck();
+    
+    // Only the gate and the graph look at the threshold, and while we're
+    // stuck the frame that goes out is the held one, so the gate doesn't
+    // either. The levels are tracked regardless, so the gate picks up right
+    // where it would have once we're unstuck.
+    const bool thresholding = (stage_plan.gate && not stuck) || graphing;
+    // Linked channels share a threshold, worked out from all of them at once.
+    const bool linked = is_linked();
+    std::vector<ChunkProcessor>& analysis = linked ? link_processors : chunk_processors;
+    if (linked) {
+        link_processors[0].link_lines(chunk_processors, stereo_mode == StereoMode::linked_sum);
+    }
+    for (auto& chunk : analysis) {
+        chunk.track_levels(speed);
+    }
+    if (thresholding && stage_plan.dynamic_threshold) {
+        for (auto& chunk : analysis) {
+            chunk.analyze_bands(band_reduction);
+        }
+        ChunkProcessor::spread_bands(spread_matrix, analysis);
+    }
+    for (auto& chunk : analysis) {
+        if (thresholding) {
+            chunk.build_threshold(masking_amount, stage_plan);
+        }
+        if (graphing && (overlay == GraphOverlay::spread)) {
+            chunk.build_spread_demo(spread_matrix, masking_amount);
+        }
+    }
     for (int c = 0; c < num_channels; ++c) {
-        mdct->transform(chunk_processors[c].raw_samples, chunk_processors[c].raw_freq_lines, start_pos);
+        if (stuck) {
+            chunk_processors[c].recover_packet();
+        } else {
+            chunk_processors[c].apply_threshold(bit_reduction_above_threshold,
+                                                gate_ratio,
+                                                stage_plan,
+                                                analysis[linked ? 0 : c]);
+        }
+    }
+
+    frame_mdct->inverse_transform_hop(processed_sample_channels, processed_freq_channels, raw_sample_channels, start_pos, mix);
+    
+    if (graphing) {
+        prepare_graph_lines(overlay);
+        graph_requested.store(false, std::memory_order_release);
     }
     
+    // A frame that got through is the one to fall back on next time.
+    if (not stuck) {
+        for (int c = 0; c < num_channels; ++c) {
+            chunk_processors[c].keep_frame();
+            processed_freq_channels[c] = chunk_processors[c].processed_freq_lines.data();
+        }
+    }
+}
+
+void EmpyModel::process_short(int start_pos)
+{
+    // The short frames start 7/16 of the way into the first half of the long
+    // frame, and end as far from the end of the second half. We copy that part
+    // of the frame into a straight line, do the short frames there, and put
+    // the result back into the output buffer the same way the long inverse
+    // transform does: added to and mixed in the first half, and replacing the
+    // second.
+    const int half = MDCT_WIDTH / 2;
+    const int other_half = half - start_pos;
+    const int offset = (half - subblock_len) / 2;
+    const int span = subblock_len * (MdctPlan::SHORT_FRAMES + 1);
+    
     for (int c = 0; c < num_channels; ++c) {
-        chunk_processors[c].build_threshold(kernel,
-                                            kernel_center,
-                                            masking_amount,
-                                            absolute_threshold_level,
-                                            speed,
-                                            perceptual_curve);
-        chunk_processors[c].apply_threshold(bit_reduction_above_threshold,
-                                            gate_ratio);
+        const std::span<const floattype> raw = chunk_processors[c].raw_samples;
+        std::copy(raw.begin() + start_pos + offset, raw.begin() + start_pos + half, short_inputs[c].begin());
+        std::copy(raw.begin() + other_half, raw.begin() + other_half + offset + span - half, short_inputs[c].begin() + half - offset);
+        std::fill(short_outputs[c].begin(), short_outputs[c].end(), 0);
     }
     
+    // The loss model moves on once per long frame, so sticking sounds the
+    // same with and without block switching.
     in_loss_state = lossModel.tick();
+    const bool stuck = is_stuck();
+    // See process_long().
+    const bool thresholding = stage_plan.gate && not stuck;
+    const bool linked = is_linked();
+    std::vector<ChunkProcessor>& analysis = linked ? short_link_processors : short_chunk_processors;
+    for (int s = 0; s < MdctPlan::SHORT_FRAMES; ++s) {
+        for (int c = 0; c < num_channels; ++c) {
+            short_mdct->transform(&short_inputs[c][s * subblock_len],
+                                  &short_inputs[c][(s + 1) * subblock_len],
+                                  &short_chunk_processors[c].raw_freq_lines[0]);
+        }
+        if (linked) {
+            short_link_processors[0].link_lines(short_chunk_processors, stereo_mode == StereoMode::linked_sum);
+        }
+        for (auto& chunk : analysis) {
+            chunk.track_levels(speed);
+        }
+        if (thresholding && stage_plan.dynamic_threshold) {
+            for (auto& chunk : analysis) {
+                chunk.analyze_bands(band_reduction);
+            }
+            ChunkProcessor::spread_bands(spread_matrix, analysis);
+        }
+        if (thresholding) {
+            for (auto& chunk : analysis) {
+                chunk.build_threshold(masking_amount, stage_plan);
+            }
+        }
+        for (int c = 0; c < num_channels; ++c) {
+            ChunkProcessor& chunk = short_chunk_processors[c];
+            if (stuck) {
+                chunk.recover_packet();
+            } else {
+                chunk.apply_threshold(bit_reduction_above_threshold,
+                                      gate_ratio,
+                                      stage_plan,
+                                      analysis[linked ? 0 : c]);
+            }
+            short_mdct->inverseTransform(&short_outputs[c][s * subblock_len],
+                                         &short_outputs[c][(s + 1) * subblock_len],
+                                         &chunk.processed_freq_lines[0]);
+            if (not stuck) {
+                chunk.keep_frame();
+            }
+        }
+    }
+    
     for (int c = 0; c < num_channels; ++c) {
-        if (is_stuck()) {
-            chunk_processors[c].recover_packet();
-        } else {
-            chunk_processors[c].prev_processed_lines = chunk_processors[c].processed_freq_lines;
+        floattype* first = &chunk_processors[c].processed_samples[start_pos];
+        floattype* second = &chunk_processors[c].processed_samples[other_half];
+        const floattype* dry = &chunk_processors[c].raw_samples[start_pos];
+        const floattype* out = &short_outputs[c][0];
+        for (int i = 0; i < offset; ++i) {
+            first[i] = mix * first[i] + (1 - mix) * dry[i];
+        }
+        for (int i = offset; i < half; ++i) {
+            first[i] = mix * (first[i] + out[i - offset]) + (1 - mix) * dry[i];
+        }
+        for (int i = half; i < offset + span; ++i) {
+            second[i - half] = out[i - offset];
         }
+        std::fill(second + offset + span - half, second + half, 0);
     }
+}
 
+void EmpyModel::delay_and_detect(std::vector<float *>& block_channels, int input_index, int num_samples)
+{
+    // Swaps the input, in place, for the input from lookahead_len samples ago,
+    // and measures the energy of the new input for the transient detector. We
+    // differentiate the input first, as a cheap high pass filter, so that bass
+    // notes don't hide the attacks.
     for (int c = 0; c < num_channels; ++c) {
-        mdct->inverseTransform(chunk_processors[c].processed_samples, chunk_processors[c].processed_freq_lines, start_pos);
+        float* samples = block_channels[c] + input_index;
+        floattype* delay = &lookahead[c][lookahead_index];
+        floattype prev = transient_prev_sample[c];
+        floattype energy = transient_energy[c];
+        floattype sample, diff;
+        for (int i = 0; i < num_samples; ++i) {
+            sample = samples[i];
+            diff = sample - prev;
+            energy += diff * diff;
+            prev = sample;
+            samples[i] = delay[i];
+            delay[i] = sample;
+        }
+        transient_prev_sample[c] = prev;
+        transient_energy[c] = energy;
+    }
+    lookahead_index += num_samples;
+    if (lookahead_index == lookahead_len) {
+        lookahead_index = 0;
     }
     
-    prepare_graph_lines();
+    subblock_fill += num_samples;
+    if (subblock_fill == subblock_len) {
+        subblock_fill = 0;
+        bool transient = false;
+        for (int c = 0; c < num_channels; ++c) {
+            if ((transient_energy[c] > TRANSIENT_RATIO * transient_average[c]) &&
+                (transient_energy[c] > TRANSIENT_FLOOR * subblock_len)) {
+                transient = true;
+            }
+            transient_average[c] += TRANSIENT_AVERAGE_SPEED * (transient_energy[c] - transient_average[c]);
+            transient_energy[c] = 0;
+        }
+        if (transient) {
+            transient_countdown = MdctPlan::SHORT_FRAMES;
+        } else if (transient_countdown > 0) {
+            --transient_countdown;
+        }
+    }
 }
 
 void EmpyModel::processBlock(juce::AudioBuffer<float>& buffer)
@@ -107,32 +473,30 @@ void EmpyModel::processBlock(juce::AudioBuffer<float>& buffer)
     // results, we need to be a bit cleverer, summing two neighboring windows together.
     int num_samples;
     
-    std::vector<float *> channel_samples;
-    channel_samples.resize(num_channels);
-    
     for (int c = 0; c < num_channels; ++c) {
         channel_samples[c] = buffer.getWritePointer(c);
     }
     num_samples = buffer.getNumSamples();
     
+    // Offline, we don't leave the tables to the message thread, which could
+    // be any number of blocks behind, or not running at all. Taking any that
+    // it's made first lets us make the ones for the latest settings, and
+    // holding the lock throughout stops it slipping an older set in between.
+    if (non_realtime) {
+        const std::lock_guard<std::mutex> guard(table_lock);
+        take_fresh_tables();
+        make_fresh_tables();
+        take_fresh_tables();
+    } else {
+        take_fresh_tables();
+    }
+    
     int input_index = 0;
     
     while (input_index < num_samples) {
-        if (block_index == 0) {
-            for (int c = 0; c < num_channels; ++c) {
-                std::fill(chunk_processors[c].processed_samples.begin() + MDCT_WIDTH / 2,
-                          chunk_processors[c].processed_samples.end(),
-                          0);
-            }
-            process(block_index);
-        }
-        if (block_index == MDCT_WIDTH / 2) {
-                for (int c = 0; c < num_channels; ++c) {
-                    std::fill(chunk_processors[c].processed_samples.begin(),
-                              chunk_processors[c].processed_samples.begin() + MDCT_WIDTH / 2,
-                              0);
-                }
-            
+        // The inverse transform writes over the half of processed_samples that
+        // the new frame ends in, so there's nothing to clear first.
+        if ((block_index == 0) || (block_index == MDCT_WIDTH / 2)) {
             process(block_index);
         }
 
@@ -143,13 +507,52 @@ void EmpyModel::processBlock(juce::AudioBuffer<float>& buffer)
             steps_til_process = MDCT_WIDTH - block_index;
         }
         steps_til_process = std::min(steps_til_process, num_samples - input_index);
-        floattype dry, wet;
-        for (int c = 0; c < num_channels; ++c) {
+        
+        // The input goes in window_zeros samples behind the block index, and
+        // the output (and the dry signal, to keep it in time with the output)
+        // comes out window_zeros ahead. We stop wherever either of them wraps
+        // around, so the loop below doesn't need to.
+        const int write_index = (block_index + MDCT_WIDTH - window_zeros) % MDCT_WIDTH;
+        const int read_index = (block_index + window_zeros) % MDCT_WIDTH;
+        steps_til_process = std::min(steps_til_process, MDCT_WIDTH - write_index);
+        steps_til_process = std::min(steps_til_process, MDCT_WIDTH - read_index);
+        
+        // With block switching, the input goes through the lookahead delay
+        // first. We also stop at the end of the delay line, and at the end of
+        // each of the transient detector's sub-blocks.
+        if (lookahead_len > 0) {
+            steps_til_process = std::min(steps_til_process, lookahead_len - lookahead_index);
+            steps_til_process = std::min(steps_til_process, subblock_len - subblock_fill);
+            delay_and_detect(channel_samples, input_index, steps_til_process);
+        }
+        // The output was mixed with the dry signal when the frame was finished,
+        // so all that's left is to swap it for the input.
+        if (stereo_mode == StereoMode::mid_side) {
+            // In mid/side, the model only ever sees the mid and side, and
+            // hands back left and right.
+            float* left = channel_samples[0] + input_index;
+            float* right = channel_samples[1] + input_index;
+            floattype* mid = &chunk_processors[0].raw_samples[write_index];
+            floattype* side = &chunk_processors[1].raw_samples[write_index];
+            const floattype* processed_mid = &chunk_processors[0].processed_samples[read_index];
+            const floattype* processed_side = &chunk_processors[1].processed_samples[read_index];
             for (int i = 0; i < steps_til_process; ++i) {
-                dry = chunk_processors[c].raw_samples[block_index + i];
-                wet = chunk_processors[c].processed_samples[block_index + i];
-                chunk_processors[c].raw_samples[block_index + i] = channel_samples[c][input_index + i];
-                channel_samples[c][input_index + i] = wet * mix + dry * (1 - mix);
+                const floattype l = left[i];
+                const floattype r = right[i];
+                mid[i] = (floattype)0.5 * (l + r);
+                side[i] = (floattype)0.5 * (l - r);
+                left[i] = (float)(processed_mid[i] + processed_side[i]);
+                right[i] = (float)(processed_mid[i] - processed_side[i]);
+            }
+        } else {
+            for (int c = 0; c < num_channels; ++c) {
+                float* samples = channel_samples[c] + input_index;
+                floattype* raw = &chunk_processors[c].raw_samples[write_index];
+                const floattype* processed = &chunk_processors[c].processed_samples[read_index];
+                for (int i = 0; i < steps_til_process; ++i) {
+                    raw[i] = samples[i];
+                    samples[i] = (float)processed[i];
+                }
             }
         }
         block_index += steps_til_process;
@@ -176,8 +579,11 @@ floattype linpower(const floattype input, const floattype transition_point)
 void EmpyModel::set_mask_threshold(const floattype new_threshold)
 {
     
-    masking_amount = linpower(new_threshold * 1.4, 1.0);
-
+    const floattype new_amount = linpower(new_threshold * 1.4, 1.0);
+    if (new_amount != masking_amount) {
+        masking_amount = new_amount;
+        update_stage_plan();
+    }
 }
 
 void EmpyModel::set_spread_distance(const floattype new_distance)
@@ -207,11 +613,16 @@ void EmpyModel::set_spread_distance(const floattype new_distance)
     for (int i = 0; i < kernel_size; ++i) {
         kernel[i] /= kernelsum;
     }
+    
+    spread_matrix = ChunkProcessor::build_spread_matrix(kernel, kernel_center);
 }
 
 void EmpyModel::set_bit_reduction_above_threshold(const floattype new_redux)
 {
-    bit_reduction_above_threshold = new_redux;
+    if (new_redux != bit_reduction_above_threshold) {
+        bit_reduction_above_threshold = new_redux;
+        update_stage_plan();
+    }
 }
 
 void EmpyModel::set_packet_loss(const floattype probability,
@@ -247,32 +658,150 @@ void EmpyModel::set_speed(const floattype new_speed)
 void EmpyModel::set_mdct_size(const floattype new_size)
 {
     if (new_size != MDCT_LINES) {
-        prepare(new_size, SAMPLE_RATE, num_channels);
+        configure((int)new_size);
     }
 }
 
 
 void EmpyModel::set_absolute_threshold(const floattype new_abs_threshold)
 {
-    absolute_threshold_level = std::pow(10.f, new_abs_threshold * 25 - 22);
+    // All the way down is a level of 1e-22, not 0: that's still above some of
+    // the quietest lines, so the gate can still act on them, and the static
+    // threshold always has something to do. The level is snapped to the
+    // static thresholds' grid first, so moving the slider only does anything
+    // when it moves a whole step. refresh_tables() looks up the threshold for
+    // it.
+    const floattype new_level = std::pow(10.f, new_abs_threshold * 25 - 22);
+    const floattype snapped_level = StaticThreshold::quantize_level(new_level);
+    if (snapped_level != absolute_threshold_level) {
+        absolute_threshold_level = snapped_level;
+        share_settings();
+    }
+}
+
+void EmpyModel::update_stage_plan()
+{
+    stage_plan = StagePlan::make(masking_amount,
+                                 gate_ratio,
+                                 bit_reduction_above_threshold);
 }
 
 void EmpyModel::set_bias(const floattype new_bias)
 {
-    if (new_bias != bias) {
-        for (int c = 0; c < num_channels; ++c) {
-            chunk_processors[c].build_bias(new_bias);
-        }
-        bias = new_bias;
-        for (int f = 0; f < MDCT_LINES; ++f) {
-            graphScaledLines.bias[f] = std::log10(chunk_processors[0].bias_curve[f]) * 10;
-        }
+    // All the channels share a curve, from the ones prepare() got. Snapping
+    // the bias to their grid first means we only do anything when it moves a
+    // whole step, and then it's just a matter of handing the new one out.
+    const floattype snapped_bias = BiasCurve::quantize(new_bias);
+    if (snapped_bias != bias) {
+        bias = snapped_bias;
+        share_tables();
     }
 }
 
 void EmpyModel::set_perceptual_curve(const floattype new_perceptual_curve)
 {
-    perceptual_curve = new_perceptual_curve;
+    const floattype snapped_curve = StaticThreshold::quantize_curve(new_perceptual_curve);
+    if (snapped_curve != perceptual_curve) {
+        perceptual_curve = snapped_curve;
+        share_settings();
+    }
+}
+
+void EmpyModel::share_settings()
+{
+    // The version goes up after the settings are stored, so whatever
+    // refresh_tables() reads after a version is at least that new.
+    shared_level.store(absolute_threshold_level, std::memory_order_relaxed);
+    shared_perceptual_curve.store(perceptual_curve, std::memory_order_relaxed);
+    settings_version.fetch_add(1, std::memory_order_release);
+}
+
+void EmpyModel::fetch_tables(ThresholdTables& set, const TableSettings& settings)
+{
+    // The static threshold only depends on the settings, so every channel
+    // shares it (and so does any other instance with the same settings).
+    for (int lines = MIN_MDCT_LINES; lines <= MAX_MDCT_LINES; lines *= 2) {
+        set.static_thresholds[resolution_index(lines)] = StaticThreshold::get(lines, SAMPLE_RATE, settings.level, settings.perceptual_curve);
+    }
+}
+
+void EmpyModel::refresh_tables()
+{
+    const std::lock_guard<std::mutex> guard(table_lock);
+    make_fresh_tables();
+}
+
+void EmpyModel::make_fresh_tables()
+{
+    // Only with table_lock held. Waits for the audio thread to take the last
+    // ones before making more.
+    if (chunk_processors.empty() || fresh_tables_ready.load(std::memory_order_acquire)) {
+        return;
+    }
+    const unsigned int version = settings_version.load(std::memory_order_acquire);
+    if (version == fresh_version) {
+        return;
+    }
+    const TableSettings settings = { shared_level.load(std::memory_order_relaxed),
+                                     shared_perceptual_curve.load(std::memory_order_relaxed) };
+    fetch_tables(fresh_tables, settings);
+    fresh_version = version;
+    fresh_tables_ready.store(true, std::memory_order_release);
+}
+
+void EmpyModel::take_fresh_tables()
+{
+    // They're always for settings at least as new as the ones ours were made
+    // for, so we always take them, even if the settings have moved on since:
+    // refresh_tables() will see the newer version and make the next set.
+    // Swapping them, rather than copying, leaves our old ones for the message
+    // thread to let go of.
+    if (not fresh_tables_ready.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::swap(tables, fresh_tables);
+    share_tables();
+    fresh_tables_ready.store(false, std::memory_order_release);
+}
+
+void EmpyModel::share_tables()
+{
+    // Hands the current resolution's static threshold and bias curve to the
+    // chunk processors. Before prepare() there aren't any. This runs whenever
+    // the tables or the resolution change, so the chunk processors only ever
+    // point at tables we're holding on to as well, and never let go of the
+    // last reference to one on the audio thread.
+    if (chunk_processors.empty()) {
+        return;
+    }
+    const int index = resolution_index(MDCT_LINES);
+    const int step = BiasCurve::step_index(bias);
+    for (auto* chunks : { &chunk_processors, &link_processors }) {
+        for (auto& chunk : *chunks) {
+            chunk.static_threshold = tables.static_thresholds[index];
+            chunk.bias_curve = bias_curves[index][step];
+        }
+    }
+    if (switching_active) {
+        const int short_index = resolution_index(MDCT_LINES / MdctPlan::SHORT_FRAMES);
+        for (auto* chunks : { &short_chunk_processors, &short_link_processors }) {
+            for (auto& chunk : *chunks) {
+                chunk.static_threshold = tables.static_thresholds[short_index];
+                chunk.bias_curve = bias_curves[short_index][step];
+            }
+        }
+    } else {
+        // The short frames' chunk processors aren't used, so rather than keep
+        // them up to date, they let go of theirs while they're still ours too.
+        for (auto* chunks : { &short_chunk_processors, &short_link_processors }) {
+            for (auto& chunk : *chunks) {
+                chunk.static_threshold.reset();
+                chunk.bias_curve.reset();
+            }
+        }
+    }
+    const std::vector<floattype>& decibels = bias_curves[index][step]->decibels;
+    std::copy(decibels.begin(), decibels.end(), graphScaledLines.bias.begin());
 }
 
 void EmpyModel::set_mix(const floattype new_mix)
@@ -282,7 +811,10 @@ void EmpyModel::set_mix(const floattype new_mix)
 
 void EmpyModel::set_gate_ratio(const floattype new_ratio)
 {
-    gate_ratio = new_ratio;
+    if (new_ratio != gate_ratio) {
+        gate_ratio = new_ratio;
+        update_stage_plan();
+    }
 }
 
 floattype safe_pow_to_db(const floattype pow) {
@@ -293,11 +825,27 @@ floattype safe_pow_to_db(const floattype pow) {
     }
 }
 
-void EmpyModel::prepare_graph_lines()
+void EmpyModel::request_graph_lines(GraphOverlay overlay)
+{
+    graph_overlay.store(overlay, std::memory_order_relaxed);
+    graph_requested.store(true, std::memory_order_release);
+}
+
+void EmpyModel::prepare_graph_lines(GraphOverlay overlay)
 {
-    // The bias line is prepared in set_bias(), because it doesn't move around as often, so it
-    // would be wasteful to call it every single block.
-    floattype raw, proc, thresh, static_thresh, dynamic_thresh, spread;
+    // The bias line is prepared in share_tables(), because it doesn't move around as often, so it
+    // would be wasteful to call it every single block. Of the other overlays,
+    // we only make the one that's being shown.
+    // The thresholds are averaged over whichever chunk processors worked them
+    // out, which is just the one when the channels are linked. In mid/side,
+    // the mid is already the average of left and right, so it's all we show.
+    std::span<const ChunkProcessor> signal_chunks = chunk_processors;
+    std::span<const ChunkProcessor> threshold_chunks = is_linked() ? link_processors : chunk_processors;
+    if (stereo_mode == StereoMode::mid_side) {
+        signal_chunks = signal_chunks.first(1);
+        threshold_chunks = threshold_chunks.first(1);
+    }
+    floattype raw, proc, thresh, overlay_thresh;
     for (int f = 0; f < MDCT_LINES; ++f) {
         // This seems to be how ableton does it: that is, if L & R are perfectly out of phase, spectrum view
         // shows no signal, if L & R are identical then both playing at once is +6dB (twice as loud) compared
@@ -305,35 +853,87 @@ void EmpyModel::prepare_graph_lines()
         raw = 0;
         proc = 0;
         thresh = 0;
-        static_thresh = 0;
-        dynamic_thresh = 0;
-        spread = 0;
+        overlay_thresh = 0;
         
-        for (auto &c : chunk_processors) {
+        for (auto &c : signal_chunks) {
             raw += c.raw_freq_lines[f];
             proc += c.processed_freq_lines[f];
+        }
+        for (auto &c : threshold_chunks) {
             thresh += c.threshold[f];
-            static_thresh += c.new_static_thresh[f];
-            dynamic_thresh += c.new_dynamic_thresh[f];
-            spread += c.spread_demo[f];
-            
-        }
-        raw /= num_channels;
-        proc /= num_channels;
-        thresh /= num_channels;
-        static_thresh /= num_channels;
-        dynamic_thresh /= num_channels;
-        spread /= num_channels;
+            switch (overlay) {
+                case GraphOverlay::static_threshold:
+                    overlay_thresh += c.static_threshold->values[f] * c.bias_curve->values[f];
+                    break;
+                case GraphOverlay::dynamic_threshold:
+                    overlay_thresh += c.new_dynamic_thresh[f];
+                    break;
+                case GraphOverlay::spread:
+                    overlay_thresh += c.spread_demo[f];
+                    break;
+                case GraphOverlay::none:
+                case GraphOverlay::bias:
+                    break;
+            }
+        }
+        raw /= signal_chunks.size();
+        proc /= signal_chunks.size();
+        thresh /= threshold_chunks.size();
+        overlay_thresh /= threshold_chunks.size();
         
         graphScaledLines.input[f] = safe_pow_to_db(raw * raw);
         graphScaledLines.output[f] = safe_pow_to_db(proc * proc);
         graphScaledLines.threshold[f] = safe_pow_to_db(thresh);
-        graphScaledLines.static_threshold[f] = safe_pow_to_db(static_thresh);
-        graphScaledLines.dynamic_threshold[f] = safe_pow_to_db(dynamic_thresh);
-        graphScaledLines.spread[f] = safe_pow_to_db(spread);
+        switch (overlay) {
+            case GraphOverlay::static_threshold:
+                graphScaledLines.static_threshold[f] = safe_pow_to_db(overlay_thresh);
+                break;
+            case GraphOverlay::dynamic_threshold:
+                graphScaledLines.dynamic_threshold[f] = safe_pow_to_db(overlay_thresh);
+                break;
+            case GraphOverlay::spread:
+                graphScaledLines.spread[f] = safe_pow_to_db(overlay_thresh);
+                break;
+            case GraphOverlay::none:
+            case GraphOverlay::bias:
+                // The bias curve is copied out by share_tables() instead.
+                break;
+        }
     }
 }
 
+void EmpyModel::set_window_shape(WindowShape new_shape)
+{
+    // Every window's transforms were made in prepare(), so this just switches
+    // to the other set, without allocating.
+    if (new_shape != window_shape) {
+        window_shape = new_shape;
+        if (not chunk_processors.empty()) {
+            configure(MDCT_LINES);
+        }
+    }
+}
+
+void EmpyModel::set_block_switching(bool new_block_switching)
+{
+    // The transforms for block switching are always there, so this only needs
+    // configure() to start (or stop) using them, and the lookahead.
+    if (new_block_switching != block_switching) {
+        block_switching = new_block_switching;
+        if (not chunk_processors.empty()) {
+            configure(MDCT_LINES);
+        }
+    }
+}
+
+int EmpyModel::get_latency_samples()
+{
+    // A sample that goes in at the block index comes back out when the block
+    // index comes back around, one window later. Before that, it might have
+    // spent some time in the lookahead delay.
+    return MDCT_WIDTH - 2 * window_zeros + lookahead_len;
+}
+
 bool EmpyModel::is_stuck()
 {
     return in_loss_state || stick_freeze;
@@ -342,3 +942,54 @@ void EmpyModel::set_stick_freeze (bool new_stickfreeze)
 {
     stick_freeze = new_stickfreeze;
 }
+
+void EmpyModel::set_non_realtime(bool new_non_realtime)
+{
+    non_realtime = new_non_realtime;
+}
+
+void EmpyModel::set_band_reduction(BandReduction new_band_reduction)
+{
+    band_reduction = new_band_reduction;
+}
+
+void EmpyModel::set_stereo_mode(StereoMode new_stereo_mode)
+{
+    if ((new_stereo_mode == StereoMode::mid_side) && (num_channels != 2)) {
+        new_stereo_mode = StereoMode::separate;
+    }
+    const bool was_mid_side = (stereo_mode == StereoMode::mid_side);
+    const bool now_mid_side = (new_stereo_mode == StereoMode::mid_side);
+    stereo_mode = new_stereo_mode;
+    if (was_mid_side != now_mid_side) {
+        convert_mid_side(now_mid_side);
+    }
+}
+
+void EmpyModel::convert_mid_side(bool to_mid_side)
+{
+    // Everything we keep from one frame to the next that the output depends
+    // on directly (the samples, and the frame to fall back on when we're
+    // stuck) is a linear function of the input. So switching between left and
+    // right and mid and side as we play is just a matter of converting it,
+    // and the sound doesn't jump. The average levels aren't, so the
+    // threshold takes a moment to settle.
+    if (chunk_processors.size() != 2) {
+        return;
+    }
+    const floattype scale = to_mid_side ? 0.5 : 1;
+    const auto convert = [scale](std::span<floattype> first, std::span<floattype> second) {
+        for (size_t i = 0; i < first.size(); ++i) {
+            const floattype a = first[i];
+            const floattype b = second[i];
+            first[i] = scale * (a + b);
+            second[i] = scale * (a - b);
+        }
+    };
+    convert(chunk_processors[0].raw_samples, chunk_processors[1].raw_samples);
+    convert(chunk_processors[0].processed_samples, chunk_processors[1].processed_samples);
+    convert(chunk_processors[0].prev_processed_lines, chunk_processors[1].prev_processed_lines);
+    if (switching_active) {
+        convert(short_chunk_processors[0].prev_processed_lines, short_chunk_processors[1].prev_processed_lines);
+    }
+}
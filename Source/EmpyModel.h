@@ -20,6 +20,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  
  The changes to the sound (calculating the threshold, applying the threshold, applying stick and quantization) actually don't happen in the EmpyModel, but in the ChunkProcessor objects owned by the EmpyModel. Since the ChunkProcessor works in the frequency domain, the EmpyModel must store samples until there are enough to transform to transform to the frequency domain, using the Modified Discrete Cosine Transform. The number of samples needed for a transform varies based on the frequency resolution set by the user. This may be larger or smaller than the length of the buffer that the EmpyModel receives from the PluginProcessor. The transforms overlap by 50%.
  
+ With the low overlap window, the first and last few samples of each window are zero, so a frame can be transformed before its last few samples have arrived, and the start of its output is final before the next frame is transformed. We run the input that many samples behind the block index, and the output that many ahead, which cuts the latency by twice the number of zeros.
+ 
+ With block switching on, a frame with a sharp attack in it is transformed as eight short frames instead of one long one, as in AAC, so the attack isn't smeared across the whole long frame. The long frames either side of a run of short frames use transition windows (see WindowTransition in mdct.h). The short frames have their own ChunkProcessors, at an eighth of the lines. To know whether the next frame will be short while there's still time to give the current one a transition window, we look half a hop ahead: the input goes through a delay line of that length before it reaches the MDCT, and the transient detector looks at it before the delay.
+ 
  The EmpyModel also prepares arrays of scaled values that are used by the frequency graph in the GUI.
  */
 
@@ -32,10 +36,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h> // rand, srand
 #include <vector>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <bit>
 
 #include <juce_audio_basics/juce_audio_basics.h>
 
 #include "mdct.h"
+#include "TransformTuner.h"
 #include "ControlParameter.h"
 #include "ChunkProcessor.h"
 #include "utils.h"
@@ -87,6 +95,38 @@ struct GraphScaledLines
         dynamic_threshold.resize(newsize, 0);
         spread.resize(newsize, 0);
     }
+    
+    void reserve(const int newsize)
+    {
+        input.reserve(newsize);
+        output.reserve(newsize);
+        threshold.reserve(newsize);
+        bias.reserve(newsize);
+        static_threshold.reserve(newsize);
+        dynamic_threshold.reserve(newsize);
+        spread.reserve(newsize);
+    }
+};
+
+// The line the graph shows on top of the input, output and threshold, which
+// depends on which control has the focus.
+enum class GraphOverlay {
+    none,
+    bias,
+    dynamic_threshold,
+    static_threshold,
+    spread
+};
+
+// How the channels are processed. Linked works out one threshold for all of
+// them, from the loudest of their lines (max) or their total power (sum), and
+// gates them all against it, so the stereo image doesn't wander. Mid/side
+// processes the mid and side of a stereo pair, rather than left and right.
+enum class StereoMode {
+    separate,
+    linked_max,
+    linked_sum,
+    mid_side
 };
 
 floattype linpower(floattype input, floattype transition_point);
@@ -94,9 +134,15 @@ floattype linpower(floattype input, floattype transition_point);
 class EmpyModel
 {
 public:
+    // The range of frequency resolutions (lines per frame) we support.
+    static constexpr int MIN_MDCT_LINES = 4;
+    static constexpr int MAX_MDCT_LINES = 4096;
+    
     EmpyModel();
     
     void set_control_parameters(std::array<ControlParameter, NUM_CONTROL_PARAMETERS>* c);
+    // Allocates everything, for every resolution and window. Not for the
+    // audio thread.
     void prepare(int mdct_step, floattype sample_rate, int num_channels);
 
     
@@ -124,8 +170,36 @@ public:
     void set_mix(const floattype new_mix);
     void set_gate_ratio(const floattype new_strength);
     void set_stick_freeze(bool new_stickfreeze);
+    void set_window_shape(WindowShape new_shape);
+    void set_block_switching(bool new_block_switching);
+    void set_band_reduction(BandReduction new_band_reduction);
+    // Mid/side needs two channels. With any other number, it's the same as
+    // separate.
+    void set_stereo_mode(StereoMode new_stereo_mode);
+    // Whether we're rendering offline, where nothing's waiting on the audio
+    // thread. Then processBlock() makes the tables refresh_tables() would,
+    // so new settings always apply from the next block, however fast the
+    // render goes and whether or not the message thread is running.
+    void set_non_realtime(bool new_non_realtime);
+    
+    // The delay between the input and the output, which depends on the
+    // frequency resolution and the window.
+    int get_latency_samples();
     
-    void prepare_graph_lines();
+    // Called every so often from the message thread, and once after prepare()
+    // and the first settings. (processBlock() does the same itself when we're
+    // rendering offline.) It waits for prepare() if that's running on another
+    // thread. Setting changes don't look anything up on the audio thread; this
+    // looks up every resolution's static threshold for the latest settings
+    // and hands them over, so every resolution always has tables for the same
+    // settings. Until then, they stay as they were. Does nothing if nothing's
+    // changed. (The bias curves don't need it: prepare() gets all of them.)
+    void refresh_tables();
+    
+    // Called by the graph each time it draws. The graph lines are only worked
+    // out on the next hop after a request, so they're made at the graph's
+    // frame rate, and not at all when there's no editor open.
+    void request_graph_lines(GraphOverlay overlay);
     
     bool is_stuck();
     
@@ -133,8 +207,70 @@ private:
     GilbertElliottModel lossModel;
     std::array<ControlParameter, NUM_CONTROL_PARAMETERS>* control_parameters;
     std::vector<ChunkProcessor> chunk_processors;
+    // Where the chunk processors keep their per-line state.
+    ChunkArena chunk_arena;
+    // When the channels are linked, the threshold is worked out by this one
+    // chunk processor instead, from all the channels' lines. It's in a vector
+    // so it can go wherever the channels' chunk processors can.
+    std::vector<ChunkProcessor> link_processors;
+    ChunkArena link_arena;
     
     void process(int start_pos);
+    void process_long(int start_pos, WindowTransition transition);
+    void process_short(int start_pos);
+    void delay_and_detect(std::vector<float *>& block_channels, int input_index, int num_samples);
+    void update_stage_plan();
+    void convert_mid_side(bool to_mid_side);
+    bool is_linked() const { return (stereo_mode == StereoMode::linked_max) || (stereo_mode == StereoMode::linked_sum); }
+    void prepare_graph_lines(GraphOverlay overlay);
+    void build_transforms();
+    void configure(int mdct_step);
+    void share_tables();
+    
+    // Where a resolution's things go in the per-resolution arrays.
+    static constexpr int NUM_RESOLUTIONS = 13;
+    static int resolution_index(int lines) { return std::countr_zero((unsigned int)lines); }
+    
+    // The static thresholds for every resolution, so changing the resolution
+    // doesn't need to make new ones.
+    struct ThresholdTables {
+        std::array<std::shared_ptr<const StaticThreshold>, NUM_RESOLUTIONS> static_thresholds;
+    };
+    // The settings they depend on.
+    struct TableSettings {
+        floattype level;
+        floattype perceptual_curve;
+    };
+    TableSettings table_settings() const { return { absolute_threshold_level, perceptual_curve }; }
+    void fetch_tables(ThresholdTables& set, const TableSettings& settings);
+    void make_fresh_tables();
+    void take_fresh_tables();
+    void share_settings();
+    ThresholdTables tables;
+    // Made by refresh_tables() for the audio thread to swap with its own.
+    // While fresh_tables_ready is false, only the message thread touches them,
+    // and while it's true, only the audio thread does, so the old ones are
+    // always let go of on the message thread.
+    ThresholdTables fresh_tables;
+    std::atomic<bool> fresh_tables_ready { false };
+    // Held while the fresh tables are made, and by prepare(), so only one
+    // thread makes them at a time, and never while prepare() is changing
+    // what they're made from. The audio thread only takes it when we're
+    // rendering offline.
+    std::mutex table_lock;
+    // A copy of the settings for refresh_tables() to read, and a count of the
+    // changes to them. The tables are made for the version they were read at,
+    // so refresh_tables() knows when there's a newer one.
+    std::atomic<floattype> shared_level { 0 };
+    std::atomic<floattype> shared_perceptual_curve { 1 };
+    std::atomic<unsigned int> settings_version { 0 };
+    unsigned int fresh_version = 0;
+    // The bias curve for every step of BiasCurve's grid, at every resolution,
+    // made in prepare(). There are few enough of them that changing the bias
+    // just picks one out, on the audio thread.
+    std::array<std::vector<std::shared_ptr<const BiasCurve>>, NUM_RESOLUTIONS> bias_curves;
+    
+    bool non_realtime = false;
     
     int block_index;
     
@@ -143,35 +279,109 @@ private:
     floattype freq_to_line(floattype freq);
     floattype line_to_freq(floattype line);
     
-    std::unique_ptr<ModifiedDiscreteCosineTransform> mdct;
+    // The transforms for one resolution and window. The ones for block
+    // switching are only there if we can switch at that resolution and
+    // window, whether block switching is on or not.
+    struct FrameTransforms {
+        std::unique_ptr<ModifiedDiscreteCosineTransform> plain;
+        std::unique_ptr<ModifiedDiscreteCosineTransform> start;
+        std::unique_ptr<ModifiedDiscreteCosineTransform> stop;
+        std::unique_ptr<ModifiedDiscreteCosineTransform> start_stop;
+        std::unique_ptr<ModifiedDiscreteCosineTransform> short_frames;
+    };
+    // One for each WindowShape.
+    static constexpr int NUM_WINDOW_SHAPES = 4;
+    std::array<std::array<FrameTransforms, NUM_RESOLUTIONS>, NUM_WINDOW_SHAPES> transforms;
+    std::shared_ptr<MdctScratch> transform_scratch;
+    
+    // The current resolution and window's transforms, from transforms.
+    ModifiedDiscreteCosineTransform* mdct = nullptr;
+    WindowShape window_shape = WindowShape::sine;
+    int window_zeros;
+    
+    // Block switching. block_switching is what the user asked for,
+    // switching_active is whether we can do it at this size and window.
+    bool block_switching = false;
+    bool switching_active;
+    ModifiedDiscreteCosineTransform* start_mdct = nullptr;
+    ModifiedDiscreteCosineTransform* stop_mdct = nullptr;
+    ModifiedDiscreteCosineTransform* start_stop_mdct = nullptr;
+    ModifiedDiscreteCosineTransform* short_mdct = nullptr;
+    std::vector<ChunkProcessor> short_chunk_processors;
+    ChunkArena short_chunk_arena;
+    std::vector<ChunkProcessor> short_link_processors;
+    ChunkArena short_link_arena;
+    // The part of a long frame covered by its short frames, in a straight
+    // line, since it can wrap around the middle of the circular buffers.
+    std::vector<std::vector<floattype>> short_inputs;
+    std::vector<std::vector<floattype>> short_outputs;
+    bool previous_short;
+    bool current_short;
+    
+    // The lookahead delay line, and the transient detector that looks at the
+    // input before it goes in. The detector measures the energy of the
+    // (differentiated) input in sub-blocks the length of a short hop.
+    std::vector<std::vector<floattype>> lookahead;
+    int lookahead_len;
+    int lookahead_index;
+    std::vector<floattype> transient_prev_sample;
+    std::vector<floattype> transient_energy;
+    std::vector<floattype> transient_average;
+    int subblock_len;
+    int subblock_fill;
+    // Counts down the sub-blocks since the last transient; the next frame is
+    // short if there was one in the last SHORT_FRAMES sub-blocks.
+    int transient_countdown;
+    std::vector<floattype*> raw_sample_channels;
+    std::vector<floattype*> raw_freq_channels;
+    std::vector<floattype*> processed_sample_channels;
+    std::vector<floattype*> processed_freq_channels;
+    // The host's buffers for the block we're in the middle of.
+    std::vector<float*> channel_samples;
     
     std::vector<floattype>kernel;
-    int kernel_size;
+    int kernel_size = 0;
     int kernel_center;
+    // The kernel as a matrix, rebuilt whenever the kernel changes. See
+    // ChunkProcessor::build_spread_matrix().
+    std::vector<floattype> spread_matrix;
     
-    floattype masking_amount;
+    floattype masking_amount = 0;
     
-    floattype bit_reduction_above_threshold;
+    floattype bit_reduction_above_threshold = 0;
     
     floattype speed;
     
     floattype step_down;
     floattype step_back;
     
-    floattype absolute_threshold_level;
+    floattype absolute_threshold_level = 0;
     
-    floattype bias;
+    floattype bias = 0;
     
-    floattype perceptual_curve;
+    floattype perceptual_curve = 1;
     
     floattype mix;
     
-    floattype gate_ratio;
+    floattype gate_ratio = 1;
+    
+    // Which parts of the threshold the settings above leave anything for.
+    // Remade by update_stage_plan() whenever one of them changes.
+    StagePlan stage_plan;
+    
+    BandReduction band_reduction = BandReduction::mean;
     
-    int num_channels;
+    StereoMode stereo_mode = StereoMode::separate;
+    
+    int num_channels = 0;
     
     bool in_loss_state;
 
     bool stick_freeze;
     
+    // Set by the editor's thread, and cleared by the audio thread once it's
+    // made the lines.
+    std::atomic<bool> graph_requested { false };
+    std::atomic<GraphOverlay> graph_overlay { GraphOverlay::none };
+    
 };
@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FourierTransform.h"
+
+FourierTransform::FourierTransform(int num_points)
+{
+    if ((num_points <= 0) || (num_points & (num_points - 1))) {
+        throw std::invalid_argument("number of points for the FFT must be a power of 2");
+    }
+    size = num_points;
+}
+
+FourierTransform::~FourierTransform()
+{
+}
+
+int FourierTransform::get_size() const
+{
+    return size;
+}
+
+std::unique_ptr<FourierTransform> FourierTransform::create(int num_points, FourierBackend backend)
+{
+#if USE_DOUBLE
+    // There's no JUCE engine for doubles, so there's nothing to choose.
+    juce::ignoreUnused(backend);
+#else
+    if (backend == FourierBackend::juce) {
+        return std::make_unique<JuceFourier>(num_points);
+    }
+#endif
+    return std::make_unique<SplitRadixFourier>(num_points);
+}
+
+FourierBackend FourierTransform::default_backend()
+{
+#if USE_DOUBLE
+    return FourierBackend::split_radix;
+#elif JUCE_MAC || JUCE_IOS || PAMPLEJUCE_IPP
+    // JUCE uses Accelerate on Apple platforms, and IPP when we've got it.
+    return FourierBackend::juce;
+#else
+    return FourierBackend::split_radix;
+#endif
+}
+
+SplitRadixFourier::SplitRadixFourier(int num_points) : FourierTransform(num_points)
+{
+    int stages = 0;
+    while ((1 << stages) < size) {
+        ++stages;
+    }
+    twiddle_offsets.resize(stages + 1, 0);
+    
+    // Twiddles are computed in double precision regardless of floattype, so the
+    // table itself doesn't add any error on top of the butterflies.
+    const double tau = 2.0 * 3.14159265358979323846;
+    for (int stage = 3; stage <= stages; ++stage) {
+        const int n = 1 << stage;
+        twiddle_offsets[stage] = (int)twiddles.size();
+        for (int k = 0; k < n / 4; ++k) {
+            double angle = -tau * (double)k / (double)n;
+            twiddles.push_back(std::complex<floattype>((floattype)std::cos(angle), (floattype)std::sin(angle)));
+        }
+        for (int k = 0; k < n / 4; ++k) {
+            double angle = -tau * 3.0 * (double)k / (double)n;
+            twiddles.push_back(std::complex<floattype>((floattype)std::cos(angle), (floattype)std::sin(angle)));
+        }
+    }
+}
+
+SplitRadixFourier::~SplitRadixFourier()
+{
+}
+
+void SplitRadixFourier::perform(const std::complex<floattype>* input, std::complex<floattype>* output) const
+{
+    int stages = 0;
+    while ((1 << stages) < size) {
+        ++stages;
+    }
+    split_radix(input, output, stages, 1);
+}
+
+void SplitRadixFourier::split_radix(const std::complex<floattype>* input, std::complex<floattype>* output, int stage, int stride) const
+{
+    const int n = 1 << stage;
+    // Decimation in time: the even samples get a half-size transform, and the
+    // samples at 1 and 3 mod 4 get quarter-size transforms, which are then
+    // combined with one butterfly per output quarter. The output is written in
+    // order, so there's no separate bit-reversal pass.
+    if (n == 1) {
+        output[0] = input[0];
+        return;
+    }
+    if (n == 2) {
+        output[0] = input[0] + input[stride];
+        output[1] = input[0] - input[stride];
+        return;
+    }
+    if (n == 4) {
+        const std::complex<floattype> a = input[0] + input[2 * stride];
+        const std::complex<floattype> b = input[0] - input[2 * stride];
+        const std::complex<floattype> c = input[stride] + input[3 * stride];
+        const std::complex<floattype> d = input[stride] - input[3 * stride];
+        // -j * d
+        const std::complex<floattype> d_rotated(d.imag(), -d.real());
+        output[0] = a + c;
+        output[1] = b + d_rotated;
+        output[2] = a - c;
+        output[3] = b - d_rotated;
+        return;
+    }
+    
+    const int quarter = n / 4;
+    split_radix(input, output, stage - 1, stride * 2);
+    split_radix(input + stride, output + 2 * quarter, stage - 2, stride * 4);
+    split_radix(input + 3 * stride, output + 3 * quarter, stage - 2, stride * 4);
+    
+    const std::complex<floattype>* w1 = &twiddles[twiddle_offsets[stage]];
+    const std::complex<floattype>* w3 = w1 + quarter;
+    for (int k = 0; k < quarter; ++k) {
+        const std::complex<floattype> a = w1[k] * output[k + 2 * quarter];
+        const std::complex<floattype> b = w3[k] * output[k + 3 * quarter];
+        const std::complex<floattype> sum = a + b;
+        const std::complex<floattype> difference = a - b;
+        // -j * (a - b)
+        const std::complex<floattype> difference_rotated(difference.imag(), -difference.real());
+        const std::complex<floattype> u0 = output[k];
+        const std::complex<floattype> u1 = output[k + quarter];
+        output[k] = u0 + sum;
+        output[k + 2 * quarter] = u0 - sum;
+        output[k + quarter] = u1 + difference_rotated;
+        output[k + 3 * quarter] = u1 - difference_rotated;
+    }
+}
+
+#if !USE_DOUBLE
+JuceFourier::JuceFourier(int num_points) : FourierTransform(num_points),
+    fourier((int)std::round(std::log2(num_points)))
+{
+}
+
+JuceFourier::~JuceFourier()
+{
+}
+
+void JuceFourier::perform(const std::complex<floattype>* input, std::complex<floattype>* output) const
+{
+    fourier.perform(input, output, false);
+}
+#endif
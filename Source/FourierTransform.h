@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ The FFT that the MDCT runs on, behind a small interface so the engine can be chosen per build (or per machine). There are two engines:
+ 
+ - SplitRadixFourier is our own split-radix transform. It works directly in floattype, so it's the only option when we're built with USE_DOUBLE, and it's what we use on platforms where JUCE would fall back to its generic engine (e.g. Linux without IPP or FFTW).
+ - JuceFourier wraps juce::dsp::FFT, which is the better choice where JUCE can hand off to Apple's Accelerate or to Intel IPP. It only handles floats.
+ 
+ There's also FourierBackend::direct, which isn't an FFT at all: for the smallest sizes, the MDCT skips the FFT and multiplies by a DCT-IV matrix instead (see ModifiedDiscreteCosineTransform). Asking create() for it gets the split-radix engine.
+ 
+ All of the engines do a forward complex transform with no scaling, the same as juce::dsp::FFT::perform with inverse = false. None of them allocate in perform().
+ */
+
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include <juce_dsp/juce_dsp.h>
+
+#include "utils.h"
+
+enum class FourierBackend {
+    split_radix,
+    juce,
+    direct
+};
+
+class FourierTransform
+{
+public:
+    // num_points: number of complex points in the transform, must be a power of 2.
+    FourierTransform(int num_points);
+    virtual ~FourierTransform();
+    
+    // input and output must not overlap.
+    virtual void perform(const std::complex<floattype>* input, std::complex<floattype>* output) const = 0;
+    
+    int get_size() const;
+    
+    // Builds an engine. Asking for an engine that isn't available in this
+    // build gets the split-radix one instead.
+    static std::unique_ptr<FourierTransform> create(int num_points, FourierBackend backend);
+    
+    // The engine we expect to be fastest on this platform.
+    static FourierBackend default_backend();
+    
+protected:
+    int size;
+};
+
+class SplitRadixFourier : public FourierTransform
+{
+public:
+    SplitRadixFourier(int num_points);
+    ~SplitRadixFourier() override;
+    
+    void perform(const std::complex<floattype>* input, std::complex<floattype>* output) const override;
+    
+private:
+    // Transforms 2^stage points, reading the input every stride samples.
+    void split_radix(const std::complex<floattype>* input, std::complex<floattype>* output, int stage, int stride) const;
+    
+    // For each stage of n points (n >= 8) we store w^k followed by w^3k for
+    // k < n/4, where w = exp(-2 pi i / n), starting at twiddle_offsets[log2(n)].
+    // Keeping each stage's twiddles together means the butterflies read them
+    // in order, rather than striding through one big table.
+    std::vector<std::complex<floattype>> twiddles;
+    std::vector<int> twiddle_offsets;
+};
+
+#if !USE_DOUBLE
+class JuceFourier : public FourierTransform
+{
+public:
+    JuceFourier(int num_points);
+    ~JuceFourier() override;
+    
+    void perform(const std::complex<floattype>* input, std::complex<floattype>* output) const override;
+    
+private:
+    juce::dsp::FFT fourier;
+};
+#endif
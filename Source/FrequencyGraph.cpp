@@ -234,6 +234,23 @@ void FrequencyGraph::resized()
 
 void FrequencyGraph::update()
 {
+    // The model only makes the lines when we ask, so when metering is off,
+    // we stop asking.
+    if (!enabled) {
+        return;
+    }
+    GraphOverlay overlay = GraphOverlay::none;
+    if ((*control_parameters)[8].focused) {
+        overlay = GraphOverlay::bias;
+    } else if ((*control_parameters)[0].focused || (*control_parameters)[4].focused) {
+        overlay = GraphOverlay::dynamic_threshold;
+    } else if ((*control_parameters)[1].focused || (*control_parameters)[9].focused) {
+        overlay = GraphOverlay::static_threshold;
+    } else if ((*control_parameters)[2].focused) {
+        overlay = GraphOverlay::spread;
+    }
+    empyModel->request_graph_lines(overlay);
+    
     input_line = build_path(graphScaledLines->input,
                             db_min,
                             db_max,
@@ -275,10 +292,10 @@ void FrequencyGraph::update()
 
 }
 
-void FrequencyGraph::set_lines(GraphScaledLines *gsl)
+void FrequencyGraph::set_model(EmpyModel *model)
 {
-    graphScaledLines = gsl;
-    
+    empyModel = model;
+    graphScaledLines = &model->graphScaledLines;
 }
 
 void FrequencyGraph::set_control_parameters(std::array<ControlParameter, NUM_CONTROL_PARAMETERS> *c)
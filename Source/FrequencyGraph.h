@@ -49,7 +49,7 @@ public:
     ~FrequencyGraph() override;
 
     
-    void set_lines(GraphScaledLines* gsl);
+    void set_model(EmpyModel* model);
     void set_control_parameters(std::array<ControlParameter, NUM_CONTROL_PARAMETERS>* c);
     
     void update() override;
@@ -74,6 +74,7 @@ private:
     juce::Path input_line, threshold_line, bias_line, static_line, dynamic_line, spread_line;
     ShadingPath output;
     
+    EmpyModel* empyModel;
     GraphScaledLines* graphScaledLines;
     std::array<ControlParameter, NUM_CONTROL_PARAMETERS>* control_parameters;
     
@@ -45,7 +45,12 @@ EmpyAudioProcessorEditor::EmpyAudioProcessorEditor (EmpyAudioProcessor& p, std::
         } else if (c.controller_type == combobox) {
             c.controller = std::make_unique<juce::ComboBox>();
             juce::ComboBox* cbox = static_cast<juce::ComboBox *>(c.controller.get());
-            cbox->addItemList(juce::StringArray{"4","8","16","32","64","128","256","512","1024","2048","4096"}, 1);
+            // Choice parameters start with an empty placeholder, so that the
+            // item ids (which start from 1) match the choice indices.
+            auto ap_choice = static_cast<juce::AudioParameterChoice*>(c.audio_parameter);
+            for (int i = 1; i < ap_choice->choices.size(); ++i) {
+                cbox->addItem(ap_choice->choices[i], i);
+            }
             cbox->addListener(this);
             // addAndMakeVisible(c.controller.get());
         } else if (c.controller_type == boolSlider) {
@@ -57,7 +62,7 @@ EmpyAudioProcessorEditor::EmpyAudioProcessorEditor (EmpyAudioProcessor& p, std::
     }
     
     
-    frequencyGraph.set_lines(&(audioProcessor.empyModel.graphScaledLines));
+    frequencyGraph.set_model(&(audioProcessor.empyModel));
 
     addAndMakeVisible(frequencyGraph);
     addAndMakeVisible(leftPanel);
@@ -100,7 +105,9 @@ EmpyAudioProcessorEditor::EmpyAudioProcessorEditor (EmpyAudioProcessor& p, std::
     middlePanel.set_sliders(bias_slider);
     
     auto resolution_combobox = static_cast<juce::ComboBox *>((*control_parameters)[5].controller.get());
-    frequencyResolutionPanel.set_combobox(resolution_combobox);
+    auto window_combobox = static_cast<juce::ComboBox *>((*control_parameters)[13].controller.get());
+    auto stereo_combobox = static_cast<juce::ComboBox *>((*control_parameters)[14].controller.get());
+    frequencyResolutionPanel.set_comboboxes(resolution_combobox, window_combobox, stereo_combobox);
     controllerListener = std::make_unique<ControllerListener>(control_parameters, &infoPanel, &titlePanel);
 
     startTimer(100);
@@ -144,6 +144,28 @@ EmpyAudioProcessor::EmpyAudioProcessor()
     control_parameters[12].min_val = 0;
     control_parameters[12].max_val = 1;
     control_parameters[12].controller_type = boolSlider;
+    
+    auto window = new juce::AudioParameterChoice(juce::ParameterID {"window", 1},
+                                                 "window",
+                                                 juce::StringArray{"","Sine","KBD","Vorbis","Low latency","Adaptive"},
+                                                 1);
+    control_parameters[13].audio_parameter = window;
+    control_parameters[13].name = "Window";
+    control_parameters[13].description = "The shape of the window used by the transform. Each has a slightly different sound. Low latency overlaps the windows less, which cuts the latency by more than a third, at the cost of a grainier sound. Adaptive switches to eight shorter windows around sharp attacks, so they stay sharp at high frequency resolutions, at the cost of a little more latency.";
+    control_parameters[13].min_val = 0;
+    control_parameters[13].max_val = 5;
+    control_parameters[13].controller_type = combobox;
+    
+    auto stereo = new juce::AudioParameterChoice(juce::ParameterID {"stereo", 1},
+                                                 "stereo",
+                                                 juce::StringArray{"","Separate","Link max","Link sum","Mid/side"},
+                                                 1);
+    control_parameters[14].audio_parameter = stereo;
+    control_parameters[14].name = "Stereo";
+    control_parameters[14].description = "How the channels are processed. Separate gives each channel its own threshold. The link modes work out one threshold for all the channels, from the loudest (max) or the total (sum) of their frequencies, which keeps the stereo image steady. Mid/side processes the mid and side instead of left and right.";
+    control_parameters[14].min_val = 0;
+    control_parameters[14].max_val = 4;
+    control_parameters[14].controller_type = combobox;
 
     for (const auto &c : control_parameters) {
         addParameter(c.audio_parameter);
@@ -161,10 +183,14 @@ EmpyAudioProcessor::EmpyAudioProcessor()
     }
     
     empyModel.set_control_parameters(&control_parameters);
+    
+    // Looks up the static thresholds for new settings, off the audio thread.
+    startTimer(50);
 }
 
 EmpyAudioProcessor::~EmpyAudioProcessor()
 {
+    stopTimer();
 #if 0
     // For some reason this runs into the same error that we were getting before. So I'm thinking it's safe to just not
     // free this memory, since it's happening at the end of the plugin's life anyway.
@@ -245,10 +271,15 @@ void EmpyAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    // Only does any work the first time the plugin runs on a machine.
+    TransformTuner::prepare();
     empyModel.prepare(1024,
                       sampleRate,
                       std::min(getTotalNumInputChannels(),getTotalNumOutputChannels()));
-    
+    // So the first block has every resolution's tables for the settings it
+    // starts with.
+    update_parameters();
+    empyModel.refresh_tables();
 }
 
 void EmpyAudioProcessor::releaseResources()
@@ -285,6 +316,11 @@ bool EmpyAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) con
 #endif
 
 
+void EmpyAudioProcessor::timerCallback()
+{
+    empyModel.refresh_tables();
+}
+
 void EmpyAudioProcessor::update_parameters()
 {
     empyModel.set_mask_threshold(static_cast<juce::AudioParameterFloat*>(control_parameters[0].audio_parameter)->get());
@@ -306,8 +342,18 @@ void EmpyAudioProcessor::update_parameters()
     int mdct_size_index = static_cast<juce::AudioParameterChoice*>(control_parameters[5].audio_parameter)->getIndex();
     int new_mdct_size = mdct_size_options[mdct_size_index];
     empyModel.set_mdct_size(new_mdct_size);
-    if (new_mdct_size != getLatencySamples()) {
-        setLatencySamples(mdct_size_options[mdct_size_index]);
+    
+    WindowShape window_options[] = { WindowShape::sine, WindowShape::sine, WindowShape::kbd, WindowShape::vorbis, WindowShape::low_overlap, WindowShape::sine };
+    int window_index = static_cast<juce::AudioParameterChoice*>(control_parameters[13].audio_parameter)->getIndex();
+    empyModel.set_window_shape(window_options[window_index]);
+    empyModel.set_block_switching(window_index == 5);
+    
+    StereoMode stereo_options[] = { StereoMode::separate, StereoMode::separate, StereoMode::linked_max, StereoMode::linked_sum, StereoMode::mid_side };
+    int stereo_index = static_cast<juce::AudioParameterChoice*>(control_parameters[14].audio_parameter)->getIndex();
+    empyModel.set_stereo_mode(stereo_options[stereo_index]);
+    
+    if (empyModel.get_latency_samples() != getLatencySamples()) {
+        setLatencySamples(empyModel.get_latency_samples());
     }
     empyModel.set_packet_loss(static_cast<juce::AudioParameterFloat*>(control_parameters[6].audio_parameter)->get(),
                               static_cast<juce::AudioParameterFloat*>(control_parameters[7].audio_parameter)->get(),
@@ -318,6 +364,7 @@ void EmpyAudioProcessor::update_parameters()
 
 void EmpyAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    empyModel.set_non_realtime(isNonRealtime());
     update_parameters();
     
     juce::ScopedNoDenormals noDenormals;
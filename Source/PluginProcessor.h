@@ -36,7 +36,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "utils.h"
 
 
-class EmpyAudioProcessor  : public juce::AudioProcessor
+class EmpyAudioProcessor  : public juce::AudioProcessor,
+                            public juce::Timer
 {
 public:
     EmpyAudioProcessor();
@@ -74,6 +75,8 @@ public:
     std::array<ControlParameter, NUM_CONTROL_PARAMETERS> control_parameters;
     
     EmpyModel empyModel;
+    
+    void timerCallback() override;
 
 private:
     void update_parameters();
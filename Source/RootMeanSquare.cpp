@@ -19,7 +19,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 RootMeanSquare::RootMeanSquare()
 {
-    mean_values.resize(0);
     rms_coeff = 1;
     decay_time = 0;
 }
@@ -44,11 +43,8 @@ int RootMeanSquare::set_decay_time(floattype num_samples)
 }
 
 
-void RootMeanSquare::tick(std::vector<floattype>& sample_in)
+void RootMeanSquare::tick(std::span<const floattype> sample_in)
 {
-    if (sample_in.size() != mean_values.size()) {
-        mean_values.resize(sample_in.size(), 0);
-    }
     floattype energy;
     for (int i = 0; i < mean_values.size(); ++i) {
         energy = sample_in[i] * sample_in[i];
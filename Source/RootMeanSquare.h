@@ -16,17 +16,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /**
- The RootMeanSquare class maintains a rolling average of the levels of all frequency lines. At any point, the decay time can be changed to a new number of samples. The tick function accepts an array of samples. If the array is the same size as the previous arrays, the class will update the values of the mean_values array to match the frequency line values in the new frame; if the incoming sample is a different size, the class will resize the mean_values array accordingly, and start from zero.
+ The RootMeanSquare class maintains a rolling average of the levels of all frequency lines. At any point, the decay time can be changed to a new number of samples. The tick function accepts an array of samples, the same size as mean_values, and moves the values of the mean_values array towards the frequency line values in the new frame. The mean_values array belongs to whoever owns the class (a ChunkProcessor keeps it in its ChunkArena), and has to be set before the first tick.
  
  Note that the mean_values array stores square of amplitude (that is, the power), not the amplitude itself. This is because we use the values in the power domain to calculate the threshold, and so leaving it like this saves redundant square roots and multiplications.
  */
 
 #pragma once
 #include <cmath>
+#include <span>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 
+#include "ChunkArena.h"
 #include "utils.h"
 
 class RootMeanSquare
@@ -35,9 +37,9 @@ public:
     RootMeanSquare();
 
     int set_decay_time(floattype num_samples);
-    void tick(std::vector<floattype>& sample_in);
+    void tick(std::span<const floattype> sample_in);
     
-    std::vector<floattype> mean_values;
+    ChunkArena::Row mean_values;
     
 private:
     floattype rms_coeff;
@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StaticThreshold.h"
+#include "AbsoluteThreshold.h"
+
+#include <cmath>
+
+StaticThreshold::StaticThreshold(int num_lines,
+                                 floattype sample_rate,
+                                 floattype level,
+                                 floattype perceptual_curve)
+{
+    std::vector<floattype> absolute_threshold(num_lines);
+    AbsoluteThreshold absoluteThreshold;
+    absoluteThreshold.fill_threshold(absolute_threshold, sample_rate);
+    
+    values.resize(num_lines);
+    for (int f = 0; f < num_lines; ++f) {
+        // The choice of 60 doesn't have much mathematical backing, although it's probably not far off from the geometric mean of the
+        // threshold.... Honestly I'm not even sure if the geometric mean is the right sort of mean to take here, especially
+        // since both axes have log scales. But really, I chose a value that made changing the curve not mess with the
+        // threshold too much, when faced with the sort of frequency spectrum expected from musical sounds.
+        floattype a = std::pow(absolute_threshold[f], perceptual_curve) * std::pow((floattype)60, (1 - perceptual_curve));
+        values[f] = a * level;
+    }
+}
+
+floattype StaticThreshold::quantize_level(floattype level)
+{
+    if (level <= 0) {
+        return 0;
+    }
+    const floattype steps = std::round(std::log10(level) * 10 / LEVEL_STEP_DB);
+    return std::pow((floattype)10, steps * LEVEL_STEP_DB / 10);
+}
+
+floattype StaticThreshold::quantize_curve(floattype perceptual_curve)
+{
+    return std::round(perceptual_curve / CURVE_STEP) * CURVE_STEP;
+}
+
+std::shared_ptr<const StaticThreshold> StaticThreshold::get(int num_lines,
+                                                            floattype sample_rate,
+                                                            floattype level,
+                                                            floattype perceptual_curve)
+{
+    // As with the MDCT plans, the registry only holds weak references, so a
+    // threshold is freed once the last channel using it moves on. Even on their
+    // grid, the settings have far more values than the plans, so whenever we
+    // add one, we clear out the ones nobody's using.
+    static std::mutex registry_lock;
+    static std::map<std::tuple<int, floattype, floattype, floattype>, std::weak_ptr<const StaticThreshold>> registry;
+    
+    level = quantize_level(level);
+    perceptual_curve = quantize_curve(perceptual_curve);
+    const auto key = std::make_tuple(num_lines, sample_rate, level, perceptual_curve);
+    std::unique_lock<std::mutex> lock(registry_lock);
+    auto found = registry.find(key);
+    if (found != registry.end()) {
+        std::shared_ptr<const StaticThreshold> threshold = found->second.lock();
+        if (threshold != nullptr) {
+            return threshold;
+        }
+    }
+    
+    // As with the bias curves, the threshold is made with the lock released,
+    // and if someone else made the same one in the meantime, we use theirs.
+    lock.unlock();
+    std::shared_ptr<const StaticThreshold> threshold = std::make_shared<const StaticThreshold>(num_lines, sample_rate, level, perceptual_curve);
+    lock.lock();
+    found = registry.find(key);
+    if (found != registry.end()) {
+        std::shared_ptr<const StaticThreshold> theirs = found->second.lock();
+        if (theirs != nullptr) {
+            return theirs;
+        }
+    }
+    std::erase_if(registry, [](const auto& entry) { return entry.second.expired(); });
+    registry[key] = threshold;
+    return threshold;
+}
@@ -0,0 +1,58 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ The static part of the threshold: the absolute threshold of hearing, bent towards a flat line by the perceptual curve, and scaled by the absolute threshold level. (The bias is applied on top, by the ChunkProcessor, so that moving it doesn't mean making a new one of these.) Unlike the dynamic threshold, it doesn't depend on the audio, only on the settings, so it's worked out once whenever they change. Each one is immutable once made, and shared by every channel, and by any other instances of the plugin with the same settings. Changing a setting means swapping in a different one. Like the bias, the level and curve are snapped to a grid, so a knob that's being automated only means a new threshold every so often, and the same settings keep turning up.
+ */
+
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "utils.h"
+
+class StaticThreshold {
+public:
+    // Far finer than anyone can hear. The curve moves the threshold by about
+    // 100 dB at most over its range, so a step of it is about 0.1 dB too.
+    static constexpr floattype LEVEL_STEP_DB = (floattype)0.1;
+    static constexpr floattype CURVE_STEP = (floattype)1 / 1024;
+    
+    StaticThreshold(int num_lines,
+                    floattype sample_rate,
+                    floattype level,
+                    floattype perceptual_curve);
+    
+    // The level (a power) and curve, snapped to the grid the thresholds are
+    // made on. A level of zero stays zero.
+    static floattype quantize_level(floattype level);
+    static floattype quantize_curve(floattype perceptual_curve);
+    
+    // Returns the threshold for these settings (snapped to the grid), making
+    // it if nobody is using one already. Like BiasCurve::get(), this can wait
+    // on a lock and allocate, so it's not for the audio thread.
+    static std::shared_ptr<const StaticThreshold> get(int num_lines,
+                                                      floattype sample_rate,
+                                                      floattype level,
+                                                      floattype perceptual_curve);
+    
+    // A power for each frequency line.
+    std::vector<floattype> values;
+};
@@ -0,0 +1,218 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TransformTuner.h"
+
+std::mutex TransformTuner::tuning_lock;
+std::atomic<bool> TransformTuner::tuned { false };
+std::array<std::atomic<int>, TransformTuner::NUM_SIZES> TransformTuner::best_backends;
+
+// Bump this if the engines change enough that old results shouldn't be trusted.
+static const int CACHE_FORMAT_VERSION = 2;
+
+void TransformTuner::prepare()
+{
+    const std::lock_guard<std::mutex> lock(tuning_lock);
+    if (tuned) {
+        return;
+    }
+    
+    const juce::File cache_file = get_cache_file();
+    if (!load(cache_file)) {
+        std::vector<FourierBackend> candidates = { FourierBackend::split_radix };
+#if !USE_DOUBLE
+        candidates.push_back(FourierBackend::juce);
+#endif
+        // Only timed for the smallest sizes, where it's available.
+        candidates.push_back(FourierBackend::direct);
+        for (int num_samples = MIN_MDCT_SIZE; num_samples <= MAX_MDCT_SIZE; num_samples *= 2) {
+            FourierBackend best = candidates[0];
+            double best_time = -1;
+            for (auto candidate : candidates) {
+                if ((candidate == FourierBackend::direct) && (num_samples > MdctPlan::MAX_DIRECT_SIZE)) {
+                    continue;
+                }
+                double t = time_backend(num_samples, candidate, best_time);
+                if ((best_time < 0) || (t < best_time)) {
+                    best_time = t;
+                    best = candidate;
+                }
+            }
+            best_backends[size_index(num_samples)] = (int)best;
+        }
+        save(cache_file);
+    }
+    tuned = true;
+}
+
+FourierBackend TransformTuner::get_backend(int num_samples)
+{
+    const int index = size_index(num_samples);
+    if ((index < 0) || !tuned) {
+        return FourierTransform::default_backend();
+    }
+    return (FourierBackend)best_backends[index].load();
+}
+
+int TransformTuner::size_index(int num_samples)
+{
+    int index = 0;
+    for (int size = MIN_MDCT_SIZE; size <= MAX_MDCT_SIZE; size *= 2) {
+        if (size == num_samples) {
+            return index;
+        }
+        ++index;
+    }
+    return -1;
+}
+
+double TransformTuner::time_backend(int num_samples, FourierBackend backend, double time_to_beat)
+{
+    // Time a forward and inverse transform of one frame, as the plugin does
+    // them, taking the best of several runs so that a context switch in the
+    // middle doesn't count against an engine. An engine that's already well
+    // behind time_to_beat (if there is one, i.e. it's positive) after a run
+    // isn't going to win, so we stop timing it there.
+    // The inverse adds into its output, so it gets a buffer of its own: if it
+    // added into the input, every frame would transform the last one's sum,
+    // and the values could grow to inf or NaN over a run, which would throw
+    // the timings off. This way the input is the same for every frame, and
+    // the output only grows by one frame's worth per frame.
+    ModifiedDiscreteCosineTransform mdct(num_samples, 1, backend);
+    const int half = num_samples / 2;
+    std::vector<floattype> time_vals(num_samples);
+    std::vector<floattype> freq_vals(half);
+    std::vector<floattype> output(num_samples);
+    for (int i = 0; i < num_samples; ++i) {
+        time_vals[i] = std::sin((floattype)i * (floattype)0.1);
+    }
+    
+    // Enough frames that each run takes a measurable amount of time even for
+    // the smallest sizes.
+    const int frames_per_run = std::max(4, (1 << 17) / num_samples);
+    const int runs = 5;
+    double best = -1;
+    for (int run = 0; run < runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames_per_run; ++frame) {
+            mdct.transform(&time_vals[0], &time_vals[half], &freq_vals[0]);
+            mdct.inverseTransform(&output[0], &output[half], &freq_vals[0]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(end - start).count();
+        if ((best < 0) || (elapsed < best)) {
+            best = elapsed;
+        }
+        if ((time_to_beat > 0) && (best / frames_per_run > 2 * time_to_beat)) {
+            break;
+        }
+        std::fill(output.begin(), output.end(), 0);
+    }
+    return best / frames_per_run;
+}
+
+juce::File TransformTuner::get_cache_file()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Wildergarden")
+        .getChildFile("Empy")
+        .getChildFile("transform_tuning.xml");
+}
+
+juce::String TransformTuner::get_machine_name()
+{
+    // The results only hold for the same CPU, and the same precision.
+    return juce::SystemStats::getCpuVendor() + " " + juce::SystemStats::getCpuModel()
+        + " (" + juce::String((int)sizeof(floattype) * 8) + " bit)";
+}
+
+juce::String TransformTuner::backend_name(FourierBackend backend)
+{
+    switch (backend) {
+        case FourierBackend::juce:
+            return "juce";
+        case FourierBackend::direct:
+            return "direct";
+        case FourierBackend::split_radix:
+        default:
+            return "split_radix";
+    }
+}
+
+bool TransformTuner::load(const juce::File& file)
+{
+    if (!file.existsAsFile()) {
+        return false;
+    }
+    std::unique_ptr<juce::XmlElement> xml = juce::parseXML(file);
+    if ((xml == nullptr) || !xml->hasTagName("transformTuning")) {
+        return false;
+    }
+    if ((xml->getIntAttribute("version") != CACHE_FORMAT_VERSION) ||
+        (xml->getStringAttribute("machine") != get_machine_name())) {
+        return false;
+    }
+    
+    std::array<bool, NUM_SIZES> found {};
+    std::array<int, NUM_SIZES> backends {};
+    for (auto* entry : xml->getChildIterator()) {
+        const int index = size_index(entry->getIntAttribute("size"));
+        if (index < 0) {
+            continue;
+        }
+        const juce::String name = entry->getStringAttribute("backend");
+        if (name == backend_name(FourierBackend::split_radix)) {
+            backends[index] = (int)FourierBackend::split_radix;
+        } else if (name == backend_name(FourierBackend::juce)) {
+            backends[index] = (int)FourierBackend::juce;
+        } else if (name == backend_name(FourierBackend::direct)) {
+            backends[index] = (int)FourierBackend::direct;
+        } else {
+            continue;
+        }
+        found[index] = true;
+    }
+    // Only trust the file if it covers every size.
+    for (int i = 0; i < NUM_SIZES; ++i) {
+        if (!found[i]) {
+            return false;
+        }
+    }
+    for (int i = 0; i < NUM_SIZES; ++i) {
+        best_backends[i] = backends[i];
+    }
+    return true;
+}
+
+void TransformTuner::save(const juce::File& file)
+{
+    juce::XmlElement xml("transformTuning");
+    xml.setAttribute("version", CACHE_FORMAT_VERSION);
+    xml.setAttribute("machine", get_machine_name());
+    int index = 0;
+    for (int num_samples = MIN_MDCT_SIZE; num_samples <= MAX_MDCT_SIZE; num_samples *= 2) {
+        auto* entry = xml.createNewChildElement("transform");
+        entry->setAttribute("size", num_samples);
+        entry->setAttribute("backend", backend_name((FourierBackend)best_backends[index].load()));
+        ++index;
+    }
+    // If we can't write the file (read-only home folder, sandboxing...) we just
+    // tune again next time.
+    if (file.getParentDirectory().createDirectory().wasOk()) {
+        xml.writeTo(file);
+    }
+}
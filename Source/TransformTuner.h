@@ -0,0 +1,72 @@
+/*
+Copyright (C) 2023  Arden Butterfield
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ Which FFT engine is fastest for which MDCT size depends on the machine, so rather than guessing, the TransformTuner times every engine at every frequency resolution the first time the plugin runs on a machine, and remembers the winners in a small XML file in the user's application data folder. After that, prepare() just loads the file.
+ 
+ The results are process-wide: every instance of the plugin reads the same table, and only the first one to call prepare() does any work. The cache file records the CPU it was made on, so copying a profile to a different machine makes it tune again rather than using the wrong winners.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include <juce_core/juce_core.h>
+
+#include "FourierTransform.h"
+#include "mdct.h"
+#include "utils.h"
+
+class TransformTuner
+{
+public:
+    // Loads the cached results, or times the engines and saves them if there
+    // aren't any (or they're from another machine). Blocks until done, so this
+    // belongs in prepareToPlay, not on the audio thread.
+    static void prepare();
+    
+    // The fastest engine for an MDCT with num_samples time domain samples. Safe
+    // to call from the audio thread. Before prepare() has run, or for sizes we
+    // don't tune, this is FourierTransform::default_backend().
+    static FourierBackend get_backend(int num_samples);
+    
+    // The MDCT sizes we tune: twice each of the frequency resolutions.
+    static const int MIN_MDCT_SIZE = 8;
+    static const int MAX_MDCT_SIZE = 8192;
+
+private:
+    static double time_backend(int num_samples, FourierBackend backend, double time_to_beat);
+    static bool load(const juce::File& file);
+    static void save(const juce::File& file);
+    static juce::File get_cache_file();
+    static juce::String get_machine_name();
+    static juce::String backend_name(FourierBackend backend);
+    static int size_index(int num_samples);
+    
+    static const int NUM_SIZES = 11;
+    
+    static std::mutex tuning_lock;
+    static std::atomic<bool> tuned;
+    // Stored as ints so they can be atomic; indexed by log2(size / MIN_MDCT_SIZE).
+    static std::array<std::atomic<int>, NUM_SIZES> best_backends;
+};
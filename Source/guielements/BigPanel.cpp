@@ -378,22 +378,34 @@ void FrequencyResolutionPanel::paint (juce::Graphics& g)
     prepare_background(g);
 
     g.setColour (TEXT_COLOR);
-    g.setFont(H2_font);
-    g.drawText ("Frequency Resolution", title_section,
+    g.setFont(H3_font);
+    g.drawText ("Transform", title_section,
                 juce::Justification::centred, true);
 }
 
-void FrequencyResolutionPanel::set_combobox(juce::ComboBox* resolution)
+void FrequencyResolutionPanel::set_comboboxes(juce::ComboBox* resolution, juce::ComboBox* window, juce::ComboBox* stereo)
 {
     resolution_combobox = resolution;
+    window_combobox = window;
+    stereo_combobox = stereo;
     addAndMakeVisible(resolution_combobox);
+    addAndMakeVisible(window_combobox);
+    addAndMakeVisible(stereo_combobox);
 }
 
 void FrequencyResolutionPanel::resized()
 {
     setUsableBounds();
-    title_section = usable_bounds.withTrimmedRight(110);
-    combobox_bounds = usable_bounds.withTrimmedLeft(title_section.getWidth());
+    // The resolution only needs room for a number, and the other two for a
+    // word or two.
+    title_section = usable_bounds.withTrimmedRight(238);
+    combobox_bounds = usable_bounds.withTrimmedLeft(title_section.getWidth()).withTrimmedRight(178);
+    window_combobox_bounds = usable_bounds.withTrimmedLeft(title_section.getWidth() + 60).withTrimmedRight(84);
+    stereo_combobox_bounds = usable_bounds.withTrimmedLeft(title_section.getWidth() + 154);
     resolution_combobox->setBounds(combobox_bounds.withSizeKeepingCentre(combobox_bounds.getWidth() - 10,
                                                                          combobox_bounds.getHeight() - 10));
+    window_combobox->setBounds(window_combobox_bounds.withSizeKeepingCentre(window_combobox_bounds.getWidth() - 10,
+                                                                            window_combobox_bounds.getHeight() - 10));
+    stereo_combobox->setBounds(stereo_combobox_bounds.withSizeKeepingCentre(stereo_combobox_bounds.getWidth() - 10,
+                                                                            stereo_combobox_bounds.getHeight() - 10));
 }
@@ -194,13 +194,17 @@ public:
     FrequencyResolutionPanel() {}
     
     void paint (juce::Graphics& g);
-    void set_combobox(juce::ComboBox* resolution);
+    void set_comboboxes(juce::ComboBox* resolution, juce::ComboBox* window, juce::ComboBox* stereo);
     void resized();
 
 private:
     juce::Rectangle<int> title_section;
     juce::Rectangle<int> combobox_bounds;
+    juce::Rectangle<int> window_combobox_bounds;
+    juce::Rectangle<int> stereo_combobox_bounds;
     
     juce::ComboBox* resolution_combobox;
+    juce::ComboBox* window_combobox;
+    juce::ComboBox* stereo_combobox;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrequencyResolutionPanel)
 };
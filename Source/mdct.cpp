@@ -39,25 +39,159 @@ void sineWindow(std::vector<floattype>& window, int window_len)
     }
 }
 
-ModifiedDiscreteCosineTransform::ModifiedDiscreteCosineTransform(int num_samples)
+void kbdWindow(std::vector<floattype>& window, int window_len, floattype alpha)
+{
+    // The Kaiser-Bessel derived window: the first half is the square root of
+    // the running sum of a Kaiser window with half + 1 points, normalised so
+    // that it ends at 1, and the second half is the mirror image.
+    const int half = window_len / 2;
+    std::vector<double> kaiser(half + 1);
+    for (int i = 0; i <= half; ++i) {
+        double x = 2.0 * (double)i / (double)half - 1.0;
+        // The zeroth order modified Bessel function of the first kind, from
+        // its power series. It converges quickly for the alphas we use.
+        double arg = PI * alpha * std::sqrt(std::max(0.0, 1.0 - x * x)) / 2.0;
+        double term = 1.0;
+        double bessel = 1.0;
+        for (int k = 1; k < 50; ++k) {
+            term *= arg / (double)k;
+            bessel += term * term;
+        }
+        kaiser[i] = bessel;
+    }
+    double total = 0;
+    for (int i = 0; i <= half; ++i) {
+        total += kaiser[i];
+    }
+    double running = 0;
+    for (int i = 0; i < half; ++i) {
+        running += kaiser[i];
+        window[i] = (floattype)std::sqrt(running / total);
+        window[window_len - 1 - i] = window[i];
+    }
+}
+
+void vorbisWindow(std::vector<floattype>& window, int window_len)
+{
+    floattype scale = PI / (floattype) window_len;
+    for (int i = 0; i < window_len; i++) {
+        floattype s = sin(scale * ((floattype) i + 0.5));
+        window[i] = sin(PI / 2.0 * s * s);
+    }
+}
+
+void lowOverlapWindow(std::vector<floattype>& window, int window_len, int zeros)
+{
+    // Each half is zeros, then a sine shaped rise, then ones, with as many
+    // ones as zeros. The rise and its mirror image in the other half of the
+    // window are what overlap with the neighbouring frames.
+    const int half = window_len / 2;
+    const int overlap = half - 2 * zeros;
+    floattype scale = PI / (floattype)(2 * overlap);
+    for (int i = 0; i < half; ++i) {
+        floattype value;
+        if (i < zeros) {
+            value = 0;
+        } else if (i < zeros + overlap) {
+            value = sin(scale * ((floattype)(i - zeros) + 0.5));
+        } else {
+            value = 1;
+        }
+        window[i] = value;
+        window[window_len - 1 - i] = value;
+    }
+}
+
+void shapedWindow(std::vector<floattype>& window, int window_len, WindowShape shape)
+{
+    switch (shape) {
+        case WindowShape::kbd:
+            kbdWindow(window, window_len, 4);
+            break;
+        case WindowShape::vorbis:
+            vorbisWindow(window, window_len);
+            break;
+        case WindowShape::low_overlap:
+            lowOverlapWindow(window, window_len, windowZeros(shape, window_len));
+            break;
+        case WindowShape::sine:
+        default:
+            sineWindow(window, window_len);
+            break;
+    }
+}
+
+int windowZeros(WindowShape shape, int window_len)
+{
+    if (shape != WindowShape::low_overlap) {
+        return 0;
+    }
+    // Leave a quarter of the hop to overlap with the neighbouring frames.
+    return 3 * (window_len / 2) / 8;
+}
+
+MdctPlan::MdctPlan(int num_samples, WindowShape shape, WindowTransition transition)
 {
     if (num_samples % 4 || !isPowerOfTwo(num_samples)) {
         throw std::invalid_argument("number of samples for MDCT must be a power of 2, and a multiple of 4");
     }
-    rot.resize(num_samples);
-    window.resize(num_samples);
-    
-    c.resize(num_samples / 4);
-    transformed_c.resize(num_samples / 4);
+    window_len = num_samples;
+    window_shape = shape;
+    window_transition = transition;
+    window_zeros = windowZeros(shape, window_len);
     
-    // The number of points in a fourier transform is 2**n where n is the order.
-    // The constructor expects the order of the transform.
-    int fourier_order = round(log2(num_samples / 4));
-    fourier = std::make_unique<juce::dsp::FFT>(fourier_order);
+    window.resize(window_len);
+    shapedWindow(window, window_len, shape);
     
-    window_len = num_samples;
+    if (transition != WindowTransition::none) {
+        // The short frames sit in the middle of their long frame, so in a
+        // squashed half, the short window's slope is centred on the middle of
+        // the half. Outside of it the window is zero, inside it's one.
+        if ((shape == WindowShape::low_overlap) || (window_len < 4 * SHORT_FRAMES)) {
+            throw std::invalid_argument("block switching needs a full overlap window, and at least 32 samples");
+        }
+        const int half = window_len / 2;
+        const int short_len = window_len / SHORT_FRAMES;
+        std::vector<floattype> short_window(short_len);
+        shapedWindow(short_window, short_len, shape);
+        
+        std::vector<floattype> squashed(half);
+        const int zeros = (half - short_len / 2) / 2;
+        for (int i = 0; i < half; ++i) {
+            if (i < zeros) {
+                squashed[i] = 0;
+            } else if (i < zeros + short_len / 2) {
+                squashed[i] = short_window[i - zeros];
+            } else {
+                squashed[i] = 1;
+            }
+        }
+        if ((transition == WindowTransition::stop) || (transition == WindowTransition::start_stop)) {
+            for (int i = 0; i < half; ++i) {
+                window[i] = squashed[i];
+            }
+        }
+        if ((transition == WindowTransition::start) || (transition == WindowTransition::start_stop)) {
+            for (int i = 0; i < half; ++i) {
+                window[window_len - 1 - i] = squashed[i];
+            }
+        }
+    }
     
-    sineWindow(window, window_len);
+    // Where forward_fold() reads the window from, on either side of N/8.
+    const int half = window_len / 2;
+    const int quarter = window_len / 4;
+    const int split = (quarter + 1) / 2;
+    fold_window_a.resize(quarter);
+    fold_window_b.resize(quarter);
+    fold_window_c.resize(quarter);
+    fold_window_d.resize(quarter);
+    for (int t = 0; t < quarter; ++t) {
+        fold_window_a[t] = (t < split) ? window[half + quarter + 2 * t] : window[2 * t - quarter];
+        fold_window_b[t] = window[half + quarter - 2 * t - 1];
+        fold_window_c[t] = window[quarter + 2 * t];
+        fold_window_d[t] = (t < split) ? window[quarter - 2 * t - 1] : window[window_len + quarter - 2 * t - 1];
+    }
     
     const floattype tau = 2.0 * PI;
     fcomp j = fcomp(0,-1);
@@ -65,128 +199,581 @@ ModifiedDiscreteCosineTransform::ModifiedDiscreteCosineTransform(int num_samples
     // python implementation.
     //   t = np.arange(0, N4)
     //   w = np.exp(-1j * 2 * np.pi * (t + 1. / 8.) / N)
-    rotation_points.resize(window_len / 4);
+    std::vector<fcomp> rotation_points(window_len / 4);
     for (int index = 0; index < window_len / 4; ++index) {
         fcomp step = ((floattype)index + (1.0 / 8.0)) / (floattype)window_len;
         rotation_points[index] = std::exp(j * step * tau);
     }
+    
+    // Both transforms apply the rotation before and after the FFT, with the
+    // 0.5, 2 / sqrt(N) and 8 / sqrt(N) scales folded in. We keep the real and
+    // imaginary parts in separate arrays so the loops that use them vectorize.
+    pre_twiddle_real.resize(window_len / 4);
+    pre_twiddle_imag.resize(window_len / 4);
+    post_twiddle_real.resize(window_len / 4);
+    post_twiddle_imag.resize(window_len / 4);
+    inverse_twiddle.resize(window_len / 4);
+    const floattype post_scale = 2.0 / sqrt(window_len);
+    const floattype inverse_scale = 8.0 / sqrt(window_len);
+    for (int index = 0; index < window_len / 4; ++index) {
+        pre_twiddle_real[index] = (floattype)0.5 * rotation_points[index].real();
+        pre_twiddle_imag[index] = (floattype)0.5 * rotation_points[index].imag();
+        post_twiddle_real[index] = post_scale * rotation_points[index].real();
+        post_twiddle_imag[index] = post_scale * rotation_points[index].imag();
+        inverse_twiddle[index] = rotation_points[index] * inverse_scale;
+    }
+    
+    // Our own FFT engine is safe to share between threads, so it lives here
+    // with the rest of the tables.
+    split_radix_fourier = std::make_unique<SplitRadixFourier>(window_len / 4);
+    
+    // The DCT-IV matrix for the direct kernels:
+    //   C[k][n] = cos(pi / M * (n + 1/2) * (k + 1/2))
+    // scaled to match the FFT path, which works out as 1 / sqrt(N) going
+    // forwards and 4 / sqrt(N) going back.
+    if (window_len <= MAX_DIRECT_SIZE) {
+        const int lines = window_len / 2;
+        direct_forward_matrix.resize(lines * lines);
+        direct_inverse_matrix.resize(lines * lines);
+        const floattype direct_forward_scale = 1.0 / sqrt(window_len);
+        const floattype direct_inverse_scale = 4.0 / sqrt(window_len);
+        for (int k = 0; k < lines; ++k) {
+            for (int n = 0; n < lines; ++n) {
+                floattype value = cos(PI / (floattype)lines * ((floattype)n + 0.5) * ((floattype)k + 0.5));
+                direct_forward_matrix[k * lines + n] = direct_forward_scale * value;
+                direct_inverse_matrix[k * lines + n] = direct_inverse_scale * value;
+            }
+        }
+    }
+}
+
+std::shared_ptr<const MdctPlan> MdctPlan::get(int num_samples, WindowShape shape, WindowTransition transition)
+{
+    // Every instance of the plugin in the process shares one plan per size.
+    // The registry only holds weak references, so a plan is freed once the
+    // last transform using it goes away.
+    static std::mutex registry_lock;
+    static std::map<std::tuple<int, WindowShape, WindowTransition>, std::weak_ptr<const MdctPlan>> registry;
+    
+    const std::lock_guard<std::mutex> lock(registry_lock);
+    std::weak_ptr<const MdctPlan>& entry = registry[std::make_tuple(num_samples, shape, transition)];
+    std::shared_ptr<const MdctPlan> plan = entry.lock();
+    if (plan == nullptr) {
+        plan = std::make_shared<const MdctPlan>(num_samples, shape, transition);
+        entry = plan;
+    }
+    return plan;
+}
+
+ModifiedDiscreteCosineTransform::ModifiedDiscreteCosineTransform(int num_samples,
+                                                                 int num_channels,
+                                                                 FourierBackend backend,
+                                                                 WindowShape shape,
+                                                                 WindowTransition transition,
+                                                                 std::shared_ptr<MdctScratch> shared_scratch) :
+    scratch((shared_scratch != nullptr) ? shared_scratch : std::make_shared<MdctScratch>()),
+    rot(scratch->rot),
+    c(scratch->c),
+    transformed_c(scratch->transformed_c)
+{
+    if (num_channels < 1) {
+        throw std::invalid_argument("MDCT needs at least one channel");
+    }
+    plan = MdctPlan::get(num_samples, shape, transition);
+    window_len = num_samples;
+    max_channels = num_channels;
+    
+    // Only the scratch space below is per instance (or shared with the
+    // transforms it's handed to); everything that depends only on the size
+    // lives in the shared plan. Nothing reads the sizes of these, so a
+    // transform is happy with more than it needs.
+    if (rot.size() < (size_t)num_samples) {
+        rot.resize(num_samples);
+    }
+    
+    // The FFT buffers hold each channel's quarter-length frame back to back,
+    // so a hop can fold all of its channels before running any of the FFTs.
+    const size_t folded_size = max_channels * num_samples / 4;
+    if (c.size() < folded_size) {
+        c.resize(folded_size);
+        transformed_c.resize(folded_size);
+    }
+    
+    first_halves.resize(max_channels);
+    second_halves.resize(max_channels);
+    channel_freqs.resize(max_channels);
+    freq_inputs.resize(max_channels);
+    first_outputs.resize(max_channels);
+    second_outputs.resize(max_channels);
+    dry_firsts.resize(max_channels);
+    dry_seconds.resize(max_channels);
+    
+    if ((backend == FourierBackend::direct) && (num_samples <= MdctPlan::MAX_DIRECT_SIZE)) {
+        fourier = nullptr;
+        switch (num_samples / 2) {
+            case 2:
+                direct_forward_kernel = &ModifiedDiscreteCosineTransform::direct_forward<2>;
+                direct_inverse_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<2, false>;
+                direct_overlap_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<2, true>;
+                break;
+            case 4:
+                direct_forward_kernel = &ModifiedDiscreteCosineTransform::direct_forward<4>;
+                direct_inverse_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<4, false>;
+                direct_overlap_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<4, true>;
+                break;
+            case 8:
+                direct_forward_kernel = &ModifiedDiscreteCosineTransform::direct_forward<8>;
+                direct_inverse_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<8, false>;
+                direct_overlap_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<8, true>;
+                break;
+            case 16:
+                direct_forward_kernel = &ModifiedDiscreteCosineTransform::direct_forward<16>;
+                direct_inverse_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<16, false>;
+                direct_overlap_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<16, true>;
+                break;
+            case 32:
+            default:
+                direct_forward_kernel = &ModifiedDiscreteCosineTransform::direct_forward<32>;
+                direct_inverse_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<32, false>;
+                direct_overlap_kernel = &ModifiedDiscreteCosineTransform::direct_inverse<32, true>;
+                break;
+        }
+    } else if ((backend == FourierBackend::split_radix) || (backend == FourierBackend::direct)) {
+        fourier = plan->split_radix_fourier.get();
+    } else {
+        own_fourier = FourierTransform::create(num_samples / 4, backend);
+        fourier = own_fourier.get();
+    }
 }
 
 ModifiedDiscreteCosineTransform::~ModifiedDiscreteCosineTransform()
 {
 }
 
-void ModifiedDiscreteCosineTransform::transform(std::vector<floattype>& time_vals, std::vector<floattype>& freq_vals, int start_pos)
+int ModifiedDiscreteCosineTransform::get_window_zeros() const
 {
-    //   N4 = N // 4
-    //   rot = np.roll(x, N4)
-    int rot_index, input_index;
-    floattype real, imag;
+    return plan->window_zeros;
+}
+
+void ModifiedDiscreteCosineTransform::transform(const floattype* first_half, const floattype* second_half, floattype* freq_vals)
+{
+    first_halves[0] = first_half;
+    second_halves[0] = second_half;
+    channel_freqs[0] = freq_vals;
+    
+    forward(1);
+}
+
+void ModifiedDiscreteCosineTransform::transform_hop(const std::vector<floattype*>& time_vals, const std::vector<floattype*>& freq_vals, int start_pos)
+{
+    jassert((start_pos == 0) || (start_pos == window_len / 2));
+    jassert(time_vals.size() == freq_vals.size());
+    const int num_channels = (int)time_vals.size();
+    const int other_half = window_len / 2 - start_pos;
+    
+    // If we're handed more channels than we have scratch space for, do them in
+    // groups.
+    for (int group = 0; group < num_channels; group += max_channels) {
+        const int group_size = std::min(max_channels, num_channels - group);
+        for (int ch = 0; ch < group_size; ++ch) {
+            const floattype* samples = time_vals[group + ch];
+            first_halves[ch] = &samples[start_pos];
+            second_halves[ch] = &samples[other_half];
+            channel_freqs[ch] = freq_vals[group + ch];
+        }
+        forward(group_size);
+    }
+}
 
-    for (int i = 0; i < window_len; ++i) {
-        rot_index = (i + (window_len / 4)) % window_len;
-        input_index = (i + start_pos) % window_len;
-        rot[rot_index] = time_vals[input_index] * window[i];
+void ModifiedDiscreteCosineTransform::inverseTransform(floattype* first_half, floattype* second_half, const floattype* freq_vals)
+{
+    freq_inputs[0] = freq_vals;
+    first_outputs[0] = first_half;
+    second_outputs[0] = second_half;
+    
+    inverse(1, false);
+}
+
+void ModifiedDiscreteCosineTransform::inverse_transform_hop(const std::vector<floattype*>& time_vals,
+                                                            const std::vector<floattype*>& freq_vals,
+                                                            const std::vector<floattype*>& dry_vals,
+                                                            int start_pos,
+                                                            floattype mix)
+{
+    jassert((start_pos == 0) || (start_pos == window_len / 2));
+    jassert(time_vals.size() == freq_vals.size());
+    jassert(time_vals.size() == dry_vals.size());
+    const int num_channels = (int)time_vals.size();
+    const int other_half = window_len / 2 - start_pos;
+    wet_gain = mix;
+    dry_gain = 1 - mix;
+    
+    for (int group = 0; group < num_channels; group += max_channels) {
+        const int group_size = std::min(max_channels, num_channels - group);
+        for (int ch = 0; ch < group_size; ++ch) {
+            floattype* samples = time_vals[group + ch];
+            const floattype* dry = dry_vals[group + ch];
+            freq_inputs[ch] = freq_vals[group + ch];
+            first_outputs[ch] = &samples[start_pos];
+            second_outputs[ch] = &samples[other_half];
+            dry_firsts[ch] = &dry[start_pos];
+            dry_seconds[ch] = &dry[other_half];
+        }
+        inverse(group_size, true);
+    }
+}
+
+void ModifiedDiscreteCosineTransform::forward(int num_channels)
+{
+    if (direct_forward_kernel != nullptr) {
+        (this->*direct_forward_kernel)(num_channels);
+        return;
+    }
+    forward_fold(num_channels);
+    perform_fourier(c, transformed_c, num_channels);
+    forward_unfold(num_channels);
+}
+
+void ModifiedDiscreteCosineTransform::inverse(int num_channels, bool overlap)
+{
+    if (direct_inverse_kernel != nullptr) {
+        (this->*(overlap ? direct_overlap_kernel : direct_inverse_kernel))(num_channels);
+        return;
+    }
+    inverse_fold(num_channels);
+    perform_fourier(transformed_c, c, num_channels);
+    if (overlap) {
+        inverse_unfold<true>(num_channels);
+    } else {
+        inverse_unfold<false>(num_channels);
+    }
+}
+
+void ModifiedDiscreteCosineTransform::perform_fourier(std::vector<fcomp>& input, std::vector<fcomp>& output, int num_channels)
+{
+    const int quarter = window_len / 4;
+    for (int ch = 0; ch < num_channels; ++ch) {
+        fourier->perform(&(input[ch * quarter]), &(output[ch * quarter]));
     }
-    // rot[:N4] = -rot[:N4]
-    for (int i = 0; i < window_len / 4; ++i) {
-        rot[i] = -rot[i];
+}
+
+// Writes the n values at in into out, backwards. Reading something backwards
+// with a stride of 2 stops the compiler vectorizing a loop, but a stride of 1
+// backwards doesn't, so the folds turn one into the other with this first.
+static void reverse_into(const floattype* __restrict in, floattype* __restrict out, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        out[i] = in[n - 1 - i];
     }
+}
+
+// One channel of forward_fold(). first_reversed and second_reversed are the
+// halves of the frame backwards, so first[quarter - 2 * t - 1] is
+// first_reversed[quarter + 2 * t], and so on. The pointers are restrict-
+// qualified here, as parameters, because that's where the compiler takes any
+// notice of it: without it, it has to check that folded doesn't overlap the
+// frame before it'll vectorize.
+static void fold_channel(const MdctPlan& plan,
+                         const floattype* __restrict first,
+                         const floattype* __restrict second,
+                         const floattype* __restrict first_reversed,
+                         const floattype* __restrict second_reversed,
+                         fcomp* __restrict folded)
+{
+    const int quarter = plan.window_len / 4;
+    const int split = (quarter + 1) / 2;
+    const floattype* w_a = &plan.fold_window_a[0];
+    const floattype* w_b = &plan.fold_window_b[0];
+    const floattype* w_c = &plan.fold_window_c[0];
+    const floattype* w_d = &plan.fold_window_d[0];
+    const floattype* twiddle_real = &plan.pre_twiddle_real[0];
+    const floattype* twiddle_imag = &plan.pre_twiddle_imag[0];
     
+    // t < N/8: the first element of the fold came from the negated part of rot.
+    for (int t = 0; t < split; ++t) {
+        const floattype real = -second[quarter + 2 * t] * w_a[t] - second_reversed[quarter + 2 * t] * w_b[t];
+        const floattype imag = first[quarter + 2 * t] * w_c[t] - first_reversed[quarter + 2 * t] * w_d[t];
+        folded[t] = fcomp(real * twiddle_real[t] + imag * twiddle_imag[t],
+                          real * twiddle_imag[t] - imag * twiddle_real[t]);
+    }
+    // t >= N/8: now the last element of the fold is the negated one.
+    for (int t = split; t < quarter; ++t) {
+        const floattype real = first[2 * t - quarter] * w_a[t] - first_reversed[2 * t - quarter] * w_b[t];
+        const floattype imag = second[2 * t - quarter] * w_c[t] + second_reversed[2 * t - quarter] * w_d[t];
+        folded[t] = fcomp(real * twiddle_real[t] + imag * twiddle_imag[t],
+                          real * twiddle_imag[t] - imag * twiddle_real[t]);
+    }
+}
+
+void ModifiedDiscreteCosineTransform::forward_fold(int num_channels)
+{
+    // The python implementation does this in several passes:
+    //   rot = np.roll(x, N4)
+    //   rot[:N4] = -rot[:N4]
     //   c = np.take(rot, 2 * t) - np.take(rot, N - 2 * t - 1) \
     //   - 1j * (np.take(rot, M + 2 * t) - np.take(rot, M - 2 * t - 1))
-    for (int t = 0; t < window_len / 4; ++t) {
-        real = rot[2 * t] - rot[window_len - 2 * t - 1];
-        imag = -(rot[window_len / 2 + 2 * t] - rot[window_len / 2 - 2 * t - 1]);
-        c[t] = fcomp(real, imag) * (floattype)0.5 * rotation_points[t];
+    //   c = 0.5 * c * w
+    // Here the roll, negation, windowing, fold and pre-twiddle are done in a
+    // single pass from the input into the FFT buffer. Working out where each
+    // element of rot came from, the fold only ever reads the two halves of the
+    // frame, in straight lines (forwards and backwards with a stride of 2), and
+    // the sign flip from rot[:N4] only depends on which side of N/8 we're on.
+    // So we split the loop in two there, and neither loop has any branches or
+    // modulos in it.
+    //
+    // That still leaves the backwards reads, which the compiler won't
+    // vectorize, so each half is copied backwards into rot first (which it
+    // will), and the fold reads that forwards instead. The window's reads are
+    // laid out in the plan in the order the fold wants them. Each half of the
+    // frame is contiguous, even when the frame as a whole wraps around a
+    // circular buffer, so there's no modulo on the indices.
+    const int half = window_len / 2;
+    const int quarter = window_len / 4;
+    floattype* first_reversed = &rot[0];
+    floattype* second_reversed = &rot[half];
+    for (int ch = 0; ch < num_channels; ++ch) {
+        reverse_into(first_halves[ch], first_reversed, half);
+        reverse_into(second_halves[ch], second_reversed, half);
+        fold_channel(*plan, first_halves[ch], second_halves[ch], first_reversed, second_reversed, &c[ch * quarter]);
     }
+}
 
-    //   c = (2. / np.sqrt(N)) * w * np.fft.fft(0.5 * c * w, N4)
-#if USE_DOUBLE
-    std::vector<std::complex<float>> c_float (c.begin(), c.end());
-    std::vector<std::complex<float>> trans_c_float(transformed_c.begin(), transformed_c.end());
-    fourier->perform(&(c_float[0]), &(trans_c_float[0]), false);
-    for (int i = 0; i < transformed_c.size(); ++i) {
-        transformed_c[i] = trans_c_float[i];
+// One channel of forward_unfold(). transformed is the FFT's output as
+// (real, imaginary) pairs, and transformed_reversed is the same backwards, so
+// the real part of c[quarter - 1 - t] is transformed_reversed[2 * t + 1].
+static void unfold_channel(const MdctPlan& plan,
+                           const floattype* __restrict transformed,
+                           const floattype* __restrict transformed_reversed,
+                           floattype* __restrict out)
+{
+    const int quarter = plan.window_len / 4;
+    const floattype* twiddle_real = &plan.post_twiddle_real[0];
+    const floattype* twiddle_imag = &plan.post_twiddle_imag[0];
+    for (int t = 0; t < quarter; ++t) {
+        const int r = quarter - 1 - t;
+        out[2 * t] = transformed[2 * t] * twiddle_real[t] - transformed[2 * t + 1] * twiddle_imag[t];
+        out[2 * t + 1] = -(transformed_reversed[2 * t + 1] * twiddle_imag[r] + transformed_reversed[2 * t] * twiddle_real[r]);
     }
-#else
-    fourier->perform(&(c[0]), &(transformed_c[0]), false);
-#endif
+}
 
-    floattype scale = 2.0 / sqrt(window_len);
-    for (int i = 0; i < window_len/4; ++i) {
-        transformed_c[i] = scale * rotation_points[i] * transformed_c[i];
-    }
+void ModifiedDiscreteCosineTransform::forward_unfold(int num_channels)
+{
+    //   c = (2. / np.sqrt(N)) * w * np.fft.fft(0.5 * c * w, N4)
     //   y = np.zeros(M)
     //   y[2 * t] = np.real(c[t])
     //   y[M - 2 * t - 1] = -np.imag(c[t])
     //   return y
-    for (int t = 0; t < window_len / 4; ++t) {
-        freq_vals[2 * t] = transformed_c[t].real();
-        freq_vals[window_len / 2 - 2 * t - 1] = -transformed_c[t].imag();
+    // The post-twiddle (with the scale folded into it) and the de-interleave
+    // into the output are done in the same pass. Written as it is above, the
+    // odd lines would be written backwards with a stride of 2, so instead we
+    // write the output forwards, two lines at a time, and read the odd line's
+    // value from a backwards copy of c (see forward_fold()).
+    const int half = window_len / 2;
+    const int quarter = window_len / 4;
+    for (int ch = 0; ch < num_channels; ++ch) {
+        // A std::complex is laid out as its real and imaginary parts, so c can
+        // be read as 2 * quarter floattypes.
+        const floattype* transformed = reinterpret_cast<const floattype*>(&transformed_c[ch * quarter]);
+        reverse_into(transformed, &rot[0], half);
+        unfold_channel(*plan, transformed, &rot[0], channel_freqs[ch]);
     }
 }
 
-void ModifiedDiscreteCosineTransform::inverseTransform(std::vector<floattype>& time_vals, std::vector<floattype>& freq_vals, int start_pos)
+// One channel of inverse_fold(). in_reversed is in backwards, so
+// in[half - 2 * t - 1] is in_reversed[2 * t].
+static void inverse_fold_channel(const MdctPlan& plan,
+                                 const floattype* __restrict in,
+                                 const floattype* __restrict in_reversed,
+                                 fcomp* __restrict folded)
+{
+    const int quarter = plan.window_len / 4;
+    const floattype* twiddle_real = &plan.pre_twiddle_real[0];
+    const floattype* twiddle_imag = &plan.pre_twiddle_imag[0];
+    for (int t = 0; t < quarter; ++t) {
+        const floattype real = in[2 * t];
+        const floattype imag = in_reversed[2 * t];
+        folded[t] = fcomp(real * twiddle_real[t] - imag * twiddle_imag[t],
+                          real * twiddle_imag[t] + imag * twiddle_real[t]);
+    }
+}
+
+void ModifiedDiscreteCosineTransform::inverse_fold(int num_channels)
 {
     //   c = np.take(x, 2 * t) + 1j * np.take(x, N - 2 * t - 1)
     //   c = 0.5 * w * c
-    floattype real, imag;
-    for (int t = 0; t < window_len / 4; ++t) {
-        real = freq_vals[2 * t];
-        imag = freq_vals[window_len / 2 - 2 * t - 1];
-        transformed_c[t] = fcomp(real, imag) * (floattype)0.5 * rotation_points[t];
-    }
-    //   c = np.fft.fft(c, M)
-#if USE_DOUBLE
-    std::vector<std::complex<float>> c_float (c.begin(), c.end());
-    std::vector<std::complex<float>> trans_c_float(transformed_c.begin(), transformed_c.end());
-    fourier->perform(&(trans_c_float[0]), &(c_float[0]), false);
-    for (int i = 0; i < transformed_c.size(); ++i) {
-        c[i] = c_float[i];
-    }
-#else
-    fourier->perform(&(transformed_c[0]), &(c[0]), false);
-#endif
-    
-    //   c = ((8 / np.sqrt(N2)) * w) * c
-    floattype scale = 8.0 / sqrt(window_len);
-    for (int i = 0; i < window_len / 4; ++i) {
-        c[i] *= rotation_points[i] * scale;
-    }
-    
-    //   rot[2 * t] = np.real(c[t])
-    //   rot[N + 2 * t] = np.imag(c[t])
-    for (int t = 0; t < window_len / 4; ++t) {
-        rot[2 * t] = c[t].real();
-        rot[window_len / 2 + 2 * t] = c[t].imag();
+    // As in forward_fold(), the backwards half is read from a backwards copy.
+    const int half = window_len / 2;
+    const int quarter = window_len / 4;
+    for (int ch = 0; ch < num_channels; ++ch) {
+        reverse_into(freq_inputs[ch], &rot[0], half);
+        inverse_fold_channel(*plan, freq_inputs[ch], &rot[0], &transformed_c[ch * quarter]);
     }
-    
-    //   t = np.arange(1, N2, 2)
-    //   rot[t] = -rot[N2 - t - 1]
-    for (int t = 1; t < window_len; t+=2) {
-        rot[t] = -rot[window_len - t - 1];
+}
+
+template <bool OVERLAP>
+void ModifiedDiscreteCosineTransform::inverse_unfold(int num_channels)
+{
+    const int half = window_len / 2;
+    const int quarter = window_len / 4;
+    const int zeros = plan->window_zeros;
+    const floattype* w = &plan->window[0];
+    jassert(zeros <= quarter);
+    for (int ch = 0; ch < num_channels; ++ch) {
+        fcomp* channel_c = &c[ch * quarter];
+        floattype* first = first_outputs[ch];
+        floattype* second = second_outputs[ch];
+        
+        //   c = ((8 / np.sqrt(N2)) * w) * c
+        for (int i = 0; i < quarter; ++i) {
+            channel_c[i] *= plan->inverse_twiddle[i];
+        }
+        
+        //   rot[2 * t] = np.real(c[t])
+        //   rot[N + 2 * t] = np.imag(c[t])
+        for (int t = 0; t < quarter; ++t) {
+            rot[2 * t] = channel_c[t].real();
+            rot[half + 2 * t] = channel_c[t].imag();
+        }
+        
+        //   t = np.arange(1, N2, 2)
+        //   rot[t] = -rot[N2 - t - 1]
+        for (int t = 1; t < window_len; t+=2) {
+            rot[t] = -rot[window_len - t - 1];
+        }
+        
+        //   t = np.arange(0, 3 * M)
+        //   y = np.zeros(N2)
+        //   y[t] = rot[t + M]
+        //   t = np.arange(3 * M, N2)
+        //   y[t] = -rot[t - 3 * M]
+        //
+        // Note: we *add* the transformed values to our output array instead of
+        // replacing them, because we want two transforms to overlap for the MDCT
+        // to work, and this cuts down on having to use a temp array and copy over
+        // yadda yadda
+        //
+        // The first half of y goes to the first half of the output, and the
+        // second half, which is split again where the sign changes, goes to the
+        // second half of the output.
+        if constexpr (OVERLAP) {
+            // As above, but this is the output stage: the overlap-add finishes
+            // the first half, so it's mixed with the dry signal in the same
+            // pass, and the second half is the start of the next overlap, so
+            // it's written over what was there. The first window_zeros samples
+            // of y are zero, and those outputs were finished by the previous
+            // frame, which is why the second half's first window_zeros samples
+            // are finished here too.
+            const floattype* dry_first = dry_firsts[ch];
+            const floattype* dry_second = dry_seconds[ch];
+            for (int t = zeros; t < half; ++t) {
+                first[t] = wet_gain * (first[t] + rot[t + quarter] * w[t]) + dry_gain * dry_first[t];
+            }
+            for (int t = half; t < half + zeros; ++t) {
+                second[t - half] = wet_gain * rot[t + quarter] * w[t] + dry_gain * dry_second[t - half];
+            }
+            for (int t = half + zeros; t < half + quarter; ++t) {
+                second[t - half] = rot[t + quarter] * w[t];
+            }
+            for (int t = half + quarter; t < window_len; ++t) {
+                second[t - half] = -rot[t - half - quarter] * w[t];
+            }
+        } else {
+            for (int t = 0; t < half; ++t) {
+                first[t] += rot[t + quarter] * w[t];
+            }
+            for (int t = half; t < half + quarter; ++t) {
+                second[t - half] += rot[t + quarter] * w[t];
+            }
+            for (int t = half + quarter; t < window_len; ++t) {
+                second[t - half] += -rot[t - half - quarter] * w[t];
+            }
+        }
     }
-    
-    //   t = np.arange(0, 3 * M)
-    //   y = np.zeros(N2)
-    //   y[t] = rot[t + M]
-    //   t = np.arange(3 * M, N2)
-    //   y[t] = -rot[t - 3 * M]
-    int output_index;
-    
-    // Note: we *add* the transformed values to our output array instead of
-    // replacing them, because we want two transforms to overlap for the MDCT
-    // to work, and this cuts down on having to use a temp array and copy over
-    // yadda yadda
-    for (int t = 0; t < window_len * 3 / 4; ++t) {
-        output_index = (t + start_pos) % window_len;
-        time_vals[output_index] += rot[t + window_len / 4] * window[t];
+}
+
+template <int LINES>
+void ModifiedDiscreteCosineTransform::direct_forward(int num_channels)
+{
+    // Split the windowed frame into quarters a, b, c, d. The MDCT of the frame
+    // is the DCT-IV of the folded sequence (-c_r - d, a - b_r), where _r means
+    // reversed. Everything's sized at compile time, so the loops unroll.
+    constexpr int Q = LINES / 2;
+    const floattype* w = &plan->window[0];
+    const floattype* matrix = &plan->direct_forward_matrix[0];
+    for (int ch = 0; ch < num_channels; ++ch) {
+        const floattype* first = first_halves[ch];
+        const floattype* second = second_halves[ch];
+        floattype* out = channel_freqs[ch];
+        
+        floattype folded[LINES];
+        for (int n = 0; n < Q; ++n) {
+            folded[n] = -second[Q - 1 - n] * w[LINES + Q - 1 - n] - second[Q + n] * w[LINES + Q + n];
+            folded[Q + n] = first[n] * w[n] - first[LINES - 1 - n] * w[LINES - 1 - n];
+        }
+        
+        // The matrix is symmetric, so we can walk it a row per input value and
+        // accumulate into the whole output at once.
+        floattype acc[LINES] = {};
+        for (int n = 0; n < LINES; ++n) {
+            const floattype value = folded[n];
+            for (int k = 0; k < LINES; ++k) {
+                acc[k] += matrix[n * LINES + k] * value;
+            }
+        }
+        for (int k = 0; k < LINES; ++k) {
+            out[k] = acc[k];
+        }
     }
-    
-    for (int t = window_len * 3 / 4; t < window_len; ++t) {
-        output_index = (t + start_pos) % window_len;
-        time_vals[output_index] += -rot[t - 3 * window_len / 4] * window[t];
+}
+
+template <int LINES, bool OVERLAP>
+void ModifiedDiscreteCosineTransform::direct_inverse(int num_channels)
+{
+    // The DCT-IV is its own inverse (up to scale), and unfolding y = (y1, y2)
+    // gives the frame (y2, -y2_r, -y1_r, -y1), windowed. The output is
+    // written the same way as the FFT path's (see inverse_unfold()).
+    constexpr int Q = LINES / 2;
+    const int zeros = plan->window_zeros;
+    const floattype* w = &plan->window[0];
+    const floattype* matrix = &plan->direct_inverse_matrix[0];
+    for (int ch = 0; ch < num_channels; ++ch) {
+        const floattype* in = freq_inputs[ch];
+        floattype* first = first_outputs[ch];
+        floattype* second = second_outputs[ch];
+        
+        floattype y[LINES] = {};
+        for (int k = 0; k < LINES; ++k) {
+            const floattype value = in[k];
+            for (int n = 0; n < LINES; ++n) {
+                y[n] += matrix[k * LINES + n] * value;
+            }
+        }
+        
+        floattype frame[2 * LINES];
+        for (int n = 0; n < Q; ++n) {
+            frame[n] = y[Q + n] * w[n];
+            frame[Q + n] = -y[LINES - 1 - n] * w[Q + n];
+            frame[LINES + n] = -y[Q - 1 - n] * w[LINES + n];
+            frame[LINES + Q + n] = -y[n] * w[LINES + Q + n];
+        }
+        
+        if constexpr (OVERLAP) {
+            const floattype* dry_first = dry_firsts[ch];
+            const floattype* dry_second = dry_seconds[ch];
+            for (int n = zeros; n < LINES; ++n) {
+                first[n] = wet_gain * (first[n] + frame[n]) + dry_gain * dry_first[n];
+            }
+            for (int n = 0; n < zeros; ++n) {
+                second[n] = wet_gain * frame[LINES + n] + dry_gain * dry_second[n];
+            }
+            for (int n = zeros; n < LINES; ++n) {
+                second[n] = frame[LINES + n];
+            }
+        } else {
+            for (int n = 0; n < LINES; ++n) {
+                first[n] += frame[n];
+                second[n] += frame[LINES + n];
+            }
+        }
     }
-    
 }
@@ -18,7 +18,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /**
  This class performs the forward and inverse versions of the Modified Discrete Cosine Transform (MDCT). Similar to the Fast Fourier Transform, the MDCT converts between the time domain (in which we get our samples in the Plugin Processor) and the frequency domain (in which we process them in the ChunkProcessor).
  
- This implementation is based on the python implementation here: https://github.com/smagt/mdct There are certainly improvements to be made here, the biggest being that it currently uses the JUCE FFT implementation, which only works with floats (!) so we spend a lot of time converting our double array to a float array, just to convert it back again.
+ This implementation is based on the python implementation here: https://github.com/smagt/mdct The FFT in the middle of it is pluggable (see FourierTransform.h). The JUCE FFT implementation only works with floats (!), so when we're built with USE_DOUBLE we always use our own split-radix FFT, which works in doubles and doesn't need any conversion or scratch allocation per call.
+ 
+ At the smallest resolutions (up to 32 lines) the FFT is only a few points long, and the overhead of calling it every few samples costs more than the arithmetic. There, FourierBackend::direct skips the FFT: the frame is folded down to one value per line, and multiplied by the DCT-IV matrix, with kernels whose size is fixed at compile time so the compiler can unroll them.
+ 
+ The window can be any of the shapes in WindowShape. They all satisfy the Princen-Bradley condition (w[n]^2 + w[n + N/2]^2 = 1, with w symmetric), which is what lets the overlapping halves of neighbouring frames cancel each other's aliasing.
  */
 #pragma once
 
@@ -28,41 +32,210 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <complex> // complex numbers
 #include <cmath> // log2()
 #include <vector>
+#include <algorithm> // std::min
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
 
 #include <juce_dsp/juce_dsp.h>
 
+#include "FourierTransform.h"
 #include "utils.h"
 
 const floattype PI = 3.14159265359;
 typedef std::complex<floattype> fcomp;
 
 
+enum class WindowShape {
+    // The classic MDCT window, sin(pi * (n + 1/2) / N).
+    sine,
+    // Kaiser-Bessel derived, as in AAC. Better stopband rejection than the
+    // sine window, at the cost of a wider main lobe.
+    kbd,
+    // The power-sine window from Vorbis.
+    vorbis,
+    // In the style of AAC-LD: zeros at both ends, a flat top, and a short sine
+    // shaped overlap of a quarter of a hop. Nothing after the last nonzero
+    // sample of the window affects the frame, so the frame can be processed
+    // that much sooner. See get_window_zeros().
+    low_overlap
+};
+
+// For block switching (see EmpyModel), a long frame next to a run of short
+// ones has one half of its window squashed down to the shape of a short
+// window, padded with ones on the inside and zeros on the outside, so that its
+// aliasing cancels with the short frames'. Which halves are squashed:
+enum class WindowTransition {
+    none,
+    // The next frame is short.
+    start,
+    // The previous frame was short.
+    stop,
+    // Both.
+    start_stop
+};
+
 bool isPowerOfTwo(int n);
 void sineWindow(std::vector<floattype>& window, int window_len);
+void kbdWindow(std::vector<floattype>& window, int window_len, floattype alpha);
+void vorbisWindow(std::vector<floattype>& window, int window_len);
+void lowOverlapWindow(std::vector<floattype>& window, int window_len, int zeros);
+void shapedWindow(std::vector<floattype>& window, int window_len, WindowShape shape);
+// How many zeros there are at each end of a window of this shape.
+int windowZeros(WindowShape shape, int window_len);
+
+struct MdctPlan
+{
+    /**
+     Everything about the transform that only depends on its size and window shape: the window, the twiddle tables and our own FFT engine. These are immutable once built, so every transform of the same size and shape, in every instance of the plugin in the process, shares one plan through get().
+     */
+    MdctPlan(int num_samples, WindowShape shape, WindowTransition transition);
+    
+    // Returns the shared plan for this size and window, building it if nobody
+    // is using one.
+    static std::shared_ptr<const MdctPlan> get(int num_samples, WindowShape shape, WindowTransition transition);
+    
+    // The short frames in block switching are this many times shorter.
+    static const int SHORT_FRAMES = 8;
+    
+    int window_len;
+    WindowShape window_shape;
+    WindowTransition window_transition;
+    int window_zeros;
+    std::vector<floattype> window;
+    // The window in the order the forward fold reads it (see forward_fold()),
+    // so each of its four reads walks forwards one at a time.
+    std::vector<floattype> fold_window_a;
+    std::vector<floattype> fold_window_b;
+    std::vector<floattype> fold_window_c;
+    std::vector<floattype> fold_window_d;
+    std::vector<floattype> pre_twiddle_real;
+    std::vector<floattype> pre_twiddle_imag;
+    std::vector<floattype> post_twiddle_real;
+    std::vector<floattype> post_twiddle_imag;
+    std::vector<fcomp> inverse_twiddle;
+    std::unique_ptr<SplitRadixFourier> split_radix_fourier;
+    
+    // The largest transform with a direct DCT-IV kernel.
+    static const int MAX_DIRECT_SIZE = 64;
+    
+    // The (symmetric) DCT-IV matrix, lines x lines, with the forward and
+    // inverse scales folded in. Only built up to MAX_DIRECT_SIZE.
+    std::vector<floattype> direct_forward_matrix;
+    std::vector<floattype> direct_inverse_matrix;
+};
+
+struct MdctScratch
+{
+    /**
+     The buffers a transform works in. They don't hold anything between calls, so transforms that are never called at the same time (e.g. all of a model's transforms, for every resolution and window) can share one set, sized for the biggest of them.
+     */
+    std::vector<floattype> rot;
+    std::vector<fcomp> c;
+    std::vector<fcomp> transformed_c;
+};
 
 class ModifiedDiscreteCosineTransform
 {
 public:
     // num_samples: number of time domain samples.
-    ModifiedDiscreteCosineTransform(int num_samples);
+    // num_channels: the most channels that will be passed to transform_hop()
+    // and inverse_transform_hop() at once. Scratch space for all of them is
+    // allocated here.
+    // backend: which FFT engine to run the transform on. direct is only used
+    // up to MdctPlan::MAX_DIRECT_SIZE; above that we use split_radix.
+    // shape: the window.
+    // transition: for block switching, which halves of the window to squash.
+    // scratch: the buffers to work in, grown if they're too small. Left out,
+    // the transform gets its own.
+    ModifiedDiscreteCosineTransform(int num_samples,
+                                    int num_channels = 1,
+                                    FourierBackend backend = FourierTransform::default_backend(),
+                                    WindowShape shape = WindowShape::sine,
+                                    WindowTransition transition = WindowTransition::none,
+                                    std::shared_ptr<MdctScratch> shared_scratch = nullptr);
     ~ModifiedDiscreteCosineTransform();
     
-    // Replaces the values in freq_vals with the transform of time_vals,
-    // assuming time_vals is a circular array starting at start_pos with
-    // length window_len.
-    void transform(std::vector<floattype>& time_vals, std::vector<floattype>& freq_vals, int start_pos);
+    // The number of zeros at each end of the window. The last this many
+    // samples of a frame don't affect its transform, and the first and last
+    // this many samples of the inverse transform are zero.
+    int get_window_zeros() const;
     
-    // Adds (NOT replaces) to the values of time_vals the inverse transform of
-    // freq_vals, assuming time_vals is circular as before.
-    void inverseTransform(std::vector<floattype>& time_vals, std::vector<floattype>& freq_vals, int start_pos);
+    // Replaces the values in freq_vals (window_len / 2 of them) with the
+    // transform of a frame of window_len samples. The frame is passed as its
+    // two halves, which don't need to be next to each other in memory, so a
+    // frame that wraps around a circular buffer can be passed without copying.
+    void transform(const floattype* first_half, const floattype* second_half, floattype* freq_vals);
+    
+    // Adds (NOT replaces) to the two halves of the frame the inverse transform
+    // of freq_vals.
+    void inverseTransform(floattype* first_half, floattype* second_half, const floattype* freq_vals);
+    
+    // The EmpyModel's side of the transform, once per hop. Each time_vals[c]
+    // is a channel's circular buffer of window_len samples, and the frame
+    // starts at start_pos, which must be 0 or window_len / 2. freq_vals[c]
+    // belongs to the same channel.
+    // These take the channels together for the sake of the output stage
+    // below, not for speed: each channel is still folded, transformed and
+    // unfolded on its own, so N channels cost N calls to transform().
+    void transform_hop(const std::vector<floattype*>& time_vals, const std::vector<floattype*>& freq_vals, int start_pos);
+    
+    // The whole output stage. Unlike inverseTransform(), it adds the first
+    // half of the frame to what the previous frame left there, which finishes
+    // those samples, and *replaces* the second half, so the output buffer
+    // never needs clearing between frames. The finished samples are mixed
+    // with dry_vals[c] (the input at the same position) on the way out, as
+    // mix * wet + (1 - mix) * dry. With a low-overlap window, the finished
+    // samples are the window_zeros after the start of each half instead.
+    void inverse_transform_hop(const std::vector<floattype*>& time_vals,
+                               const std::vector<floattype*>& freq_vals,
+                               const std::vector<floattype*>& dry_vals,
+                               int start_pos,
+                               floattype mix);
 
 private:
-    std::vector<floattype> window;
+    void forward(int num_channels);
+    void inverse(int num_channels, bool overlap);
+    
+    void forward_fold(int num_channels);
+    void forward_unfold(int num_channels);
+    void inverse_fold(int num_channels);
+    template <bool OVERLAP> void inverse_unfold(int num_channels);
+    void perform_fourier(std::vector<fcomp>& input, std::vector<fcomp>& output, int num_channels);
+    
+    template <int LINES> void direct_forward(int num_channels);
+    template <int LINES, bool OVERLAP> void direct_inverse(int num_channels);
+    
+    std::shared_ptr<const MdctPlan> plan;
     int window_len;
-    std::vector<fcomp> rotation_points;
-    std::vector<floattype> rot;
-    std::vector<fcomp> c;
-    std::vector<fcomp> transformed_c;
+    int max_channels;
+    std::shared_ptr<MdctScratch> scratch;
+    std::vector<floattype>& rot;
+    std::vector<fcomp>& c;
+    std::vector<fcomp>& transformed_c;
+    
+    // Per-channel pointers for the channels in the current call.
+    std::vector<const floattype*> first_halves;
+    std::vector<const floattype*> second_halves;
+    std::vector<floattype*> channel_freqs;
+    std::vector<const floattype*> freq_inputs;
+    std::vector<floattype*> first_outputs;
+    std::vector<floattype*> second_outputs;
+    std::vector<const floattype*> dry_firsts;
+    std::vector<const floattype*> dry_seconds;
+    floattype wet_gain = 1;
+    floattype dry_gain = 0;
+    
+    // Points either at the plan's shared engine or at own_fourier. Null when
+    // we're using the direct kernels. Only the split-radix engine is shared:
+    // JUCE's fallback engine takes a lock in perform(), so transforms on
+    // different threads sharing one would end up waiting on each other.
+    const FourierTransform* fourier;
+    std::unique_ptr<FourierTransform> own_fourier;
     
-    std::unique_ptr<juce::dsp::FFT> fourier;
+    // The direct kernels for our size, if we're using them.
+    void (ModifiedDiscreteCosineTransform::*direct_forward_kernel)(int) = nullptr;
+    void (ModifiedDiscreteCosineTransform::*direct_inverse_kernel)(int) = nullptr;
+    void (ModifiedDiscreteCosineTransform::*direct_overlap_kernel)(int) = nullptr;
 };
@@ -4,6 +4,13 @@
 #include "catch2/benchmark/catch_benchmark_all.hpp"
 #include "catch2/catch_test_macros.hpp"
 
+#include <ChunkProcessor.h>
+#include <EmpyModel.h>
+#include <mdct.h>
+
+#include <string>
+#include <vector>
+
 TEST_CASE ("Boot performance")
 {
 #if 0
@@ -47,3 +54,146 @@ BENCHMARK_ADVANCED ("Editor open and close")
 };
 #endif
 }
+
+// Hidden by default, as it takes a while. Run with: Tests "[benchmark]"
+// Catch reports the mean time per call, i.e. the time per transform.
+TEST_CASE ("MDCT performance", "[.][mdct][benchmark]")
+{
+    for (int num_samples = 8; num_samples <= 8192; num_samples *= 2)
+    {
+        std::vector<FourierBackend> backends = { FourierBackend::split_radix };
+#if !USE_DOUBLE
+        backends.push_back (FourierBackend::juce);
+#endif
+        if (num_samples <= MdctPlan::MAX_DIRECT_SIZE)
+            backends.push_back (FourierBackend::direct);
+
+        for (auto backend : backends)
+        {
+            const int half = num_samples / 2;
+            ModifiedDiscreteCosineTransform mdct (num_samples, 1, backend);
+            std::vector<floattype> samples (num_samples, 0.25);
+            std::vector<floattype> freq_vals (half, 0.25);
+            const std::string name = "MDCT " + std::to_string (num_samples) + ", backend " + std::to_string ((int) backend);
+
+            BENCHMARK (name + ", forward")
+            {
+                mdct.transform (&samples[0], &samples[half], &freq_vals[0]);
+                return freq_vals[0];
+            };
+
+            BENCHMARK (name + ", inverse")
+            {
+                mdct.inverseTransform (&samples[0], &samples[half], &freq_vals[0]);
+                return samples[0];
+            };
+        }
+    }
+}
+
+// The per-hop processing for every channel at the largest size, with the
+// channels' state in one ChunkArena (as EmpyModel does it) and with an arena
+// each. Each channel's rows come to about 180 KB in the float build, so the
+// channel counts sweep the working set from well inside a typical 1-2 MB L2
+// cache to well past it, which is where a layout difference in cache misses
+// would show up as time. So far it hasn't: on the machines it's been run on,
+// the two layouts swap places from run to run, by up to a third either way,
+// so the arena's cache benefit is unproven (the arena is there so that
+// EmpyModel::configure() doesn't allocate). For the miss counts themselves,
+// run it under a profiler on a machine that exposes hardware counters, e.g.
+//   perf stat -e cache-references,cache-misses Tests "[layout]"
+TEST_CASE ("Chunk memory layout performance", "[.][layout][benchmark]")
+{
+    const int num_lines = 4096;
+    const floattype sample_rate = 44100;
+    const std::vector<floattype> spread_matrix = ChunkProcessor::build_spread_matrix ({ 0.25, 1, 0.25 }, 1);
+    const auto threshold = StaticThreshold::get (num_lines, sample_rate, 1e-10, 1);
+    const auto bias = BiasCurve::get (num_lines, sample_rate, 0);
+    const StagePlan plan = StagePlan::make (0.5, 10, 0);
+
+    for (int num_channels : { 2, 8, 32 })
+    {
+        ChunkArena shared_arena (num_channels, num_lines);
+        std::vector<ChunkArena> separate_arenas;
+        for (int c = 0; c < num_channels; ++c)
+            separate_arenas.emplace_back (1, num_lines);
+
+        std::vector<ChunkProcessor> shared;
+        std::vector<ChunkProcessor> separate;
+        for (int c = 0; c < num_channels; ++c)
+        {
+            shared.emplace_back (num_lines, sample_rate, shared_arena, c);
+            separate.emplace_back (num_lines, sample_rate, separate_arenas[(size_t) c], 0);
+            for (auto* chunk : { &shared[(size_t) c], &separate[(size_t) c] })
+            {
+                chunk->static_threshold = threshold;
+                chunk->bias_curve = bias;
+                for (int f = 0; f < num_lines; ++f)
+                    chunk->raw_freq_lines[(size_t) f] = (floattype) ((f * 7 + c) % 13) * 0.01f;
+            }
+        }
+
+        auto process = [&] (std::vector<ChunkProcessor>& chunks) {
+            for (auto& chunk : chunks)
+            {
+                chunk.track_levels (0.2);
+                chunk.analyze_bands();
+            }
+            ChunkProcessor::spread_bands (spread_matrix, chunks);
+            for (auto& chunk : chunks)
+            {
+                chunk.build_threshold (0.5, plan);
+                chunk.apply_threshold (0, 10, plan);
+            }
+            return chunks[0].processed_freq_lines[1];
+        };
+
+        const std::string name = "4096 lines, " + std::to_string (num_channels) + " channels";
+
+        BENCHMARK (name + ", one arena")
+        {
+            return process (shared);
+        };
+
+        BENCHMARK (name + ", an arena per channel")
+        {
+            return process (separate);
+        };
+    }
+}
+
+// A stereo block through the whole model in each stereo mode, with the gate
+// on so the threshold is worked out. Linking the channels works the threshold
+// out once rather than once per channel.
+TEST_CASE ("Stereo mode performance", "[.][stereo][benchmark]")
+{
+    const int num_samples = 4096;
+    for (auto mode : { StereoMode::separate, StereoMode::linked_max, StereoMode::linked_sum, StereoMode::mid_side })
+    {
+        EmpyModel model;
+        model.prepare (1024, 44100, 2);
+        model.set_mask_threshold (0.5);
+        model.set_absolute_threshold (0.3);
+        model.set_spread_distance (2);
+        model.set_bit_reduction_above_threshold (0);
+        model.set_speed (0.2);
+        model.set_perceptual_curve (0.7);
+        model.set_mix (100);
+        model.set_gate_ratio (10);
+        model.set_packet_loss (0, 0.5, 3);
+        model.set_bias (0);
+        model.set_stick_freeze (false);
+        model.set_stereo_mode (mode);
+
+        juce::AudioBuffer<float> buffer (2, num_samples);
+        for (int c = 0; c < 2; ++c)
+            for (int i = 0; i < num_samples; ++i)
+                buffer.getWritePointer (c)[i] = (float) ((i * 7 + c * 3) % 13) * 0.01f;
+
+        BENCHMARK ("1024 lines, stereo mode " + std::to_string ((int) mode))
+        {
+            model.processBlock (buffer);
+            return buffer.getWritePointer (0)[0];
+        };
+    }
+}
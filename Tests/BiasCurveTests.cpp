@@ -0,0 +1,40 @@
+#include <BiasCurve.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+
+// A sample rate nothing else uses, so the other tests' curves don't count
+// towards the cache's limit.
+static const floattype test_sample_rate = 12345;
+
+TEST_CASE("The bias curve cache keeps recent curves, up to its limit", "[bias]")
+{
+    const int num_lines = 4096;
+    // Each curve has its values as powers and in dB.
+    const int curves_that_fit = (int)(BiasCurve::MAX_CACHED_VALUES / (2 * num_lines));
+    
+    // Nobody's holding on to the first curve, but while there's room, it's
+    // still there the next time it's asked for.
+    std::weak_ptr<const BiasCurve> first = BiasCurve::get(num_lines, test_sample_rate, 0);
+    CHECK(BiasCurve::get(num_lines, test_sample_rate, 0) == first.lock());
+    const std::shared_ptr<const BiasCurve> held = BiasCurve::get(num_lines, test_sample_rate, -2);
+    
+    // Fill the cache up, and then ask for the first one again.
+    std::weak_ptr<const BiasCurve> second = BiasCurve::get(num_lines, test_sample_rate, BiasCurve::STEP);
+    for (int step = 2; step < curves_that_fit - 1; ++step) {
+        BiasCurve::get(num_lines, test_sample_rate, step * BiasCurve::STEP);
+    }
+    CHECK(not first.expired());
+    CHECK(not second.expired());
+    BiasCurve::get(num_lines, test_sample_rate, 0);
+    
+    // Going past the limit lets go of the curves used longest ago, which
+    // aren't the first one any more. The one that's held stays.
+    for (int step = 1; step <= 10; ++step) {
+        BiasCurve::get(num_lines, test_sample_rate, -step * BiasCurve::STEP);
+    }
+    CHECK(second.expired());
+    CHECK(not first.expired());
+    CHECK(BiasCurve::get(num_lines, test_sample_rate, -2) == held);
+}
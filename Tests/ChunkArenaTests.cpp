@@ -0,0 +1,52 @@
+#include <ChunkArena.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+TEST_CASE("ChunkArena rows are aligned and don't overlap", "[arena]")
+{
+    for (int num_lines : { 4, 6, 128, 4096 }) {
+        const int num_channels = 3;
+        ChunkArena arena(num_channels, num_lines);
+        const floattype* previous_end = nullptr;
+        for (int a = 0; a < ChunkArena::NUM_ARRAYS; ++a) {
+            const auto array = (ChunkArena::Array)a;
+            const bool is_samples = (array == ChunkArena::Array::raw_samples) || (array == ChunkArena::Array::processed_samples);
+            for (int c = 0; c < num_channels; ++c) {
+                INFO("lines " << num_lines << ", array " << a << ", channel " << c);
+                const auto row = arena.get(array, c);
+                CHECK(row.size() == (size_t)(is_samples ? 2 * num_lines : num_lines));
+                CHECK((std::uintptr_t)row.data() % ChunkArena::ALIGNMENT == 0);
+                if (previous_end != nullptr) {
+                    CHECK(row.data() >= previous_end);
+                }
+                previous_end = row.data() + row.size();
+                CHECK(std::ranges::all_of(row, [](floattype value) { return value == 0; }));
+            }
+        }
+    }
+}
+
+TEST_CASE("Only one ChunkArena row points at each row of the arena", "[arena]")
+{
+    static_assert(!std::is_copy_constructible_v<ChunkArena::Row>);
+    static_assert(!std::is_copy_assignable_v<ChunkArena::Row>);
+
+    ChunkArena arena(2, 16);
+    ChunkArena::Row first(arena.get(ChunkArena::Array::threshold, 0));
+    const floattype* data = first.data();
+
+    ChunkArena::Row moved(std::move(first));
+    CHECK(moved.data() == data);
+    CHECK(moved.size() == 16);
+    CHECK(first.empty());
+
+    ChunkArena::Row other(arena.get(ChunkArena::Array::threshold, 1));
+    other = std::move(moved);
+    CHECK(other.data() == data);
+    CHECK(moved.empty());
+}
@@ -0,0 +1,295 @@
+#include <ChunkProcessor.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Runs a few frames of noise through two chunk processors, one with the plan
+// for the settings and one that does every stage of the threshold, and checks
+// that the skipped stages didn't change a single line.
+TEST_CASE("Skipping the inert stages leaves the lines exactly the same", "[chunk]")
+{
+    const int num_lines = 256;
+    const floattype sample_rate = 44100;
+    const std::vector<floattype> spread_matrix = ChunkProcessor::build_spread_matrix({ 0.25, 1, 0.25 }, 1);
+    const auto bias = BiasCurve::get(num_lines, sample_rate, 0.5);
+
+    for (floattype masking_amount : { 0.0, 0.5 }) {
+        // The bottom of the static threshold's slider, and somewhere higher.
+        for (floattype static_level : { 1e-22, 1e-6 }) {
+            for (floattype gate_ratio : { 1.0, 10.0 }) {
+                for (floattype bit_reduction : { 0.0, 6.0 }) {
+                    INFO("masking " << masking_amount << ", static " << static_level << ", ratio " << gate_ratio << ", bits " << bit_reduction);
+                    const StagePlan plan = StagePlan::make(masking_amount, gate_ratio, bit_reduction);
+                    StagePlan full_plan = plan;
+                    full_plan.dynamic_threshold = true;
+                    full_plan.gate = true;
+
+                    ChunkArena arena(2, num_lines);
+                    std::vector<ChunkProcessor> chunks;
+                    const auto static_threshold = StaticThreshold::get(num_lines, sample_rate, static_level, 1);
+                    for (int c = 0; c < 2; ++c) {
+                        chunks.emplace_back(num_lines, sample_rate, arena, c);
+                        chunks[c].static_threshold = static_threshold;
+                        chunks[c].bias_curve = bias;
+                    }
+
+                    std::mt19937 generator(1);
+                    std::normal_distribution<double> distribution(0, 0.01);
+                    bool identical = true;
+                    for (int frame = 0; frame < 8; ++frame) {
+                        for (int f = 0; f < num_lines; ++f) {
+                            const floattype line = (floattype)distribution(generator);
+                            chunks[0].raw_freq_lines[f] = line;
+                            chunks[1].raw_freq_lines[f] = line;
+                        }
+                        for (auto& chunk : chunks) {
+                            chunk.track_levels(0.2);
+                        }
+                        chunks[1].analyze_bands();
+                        if (plan.dynamic_threshold) {
+                            chunks[0].analyze_bands();
+                        }
+                        ChunkProcessor::spread_bands(spread_matrix, chunks);
+                        chunks[0].build_threshold(masking_amount, plan);
+                        chunks[0].apply_threshold(bit_reduction, gate_ratio, plan);
+                        chunks[1].build_threshold(masking_amount, full_plan);
+                        chunks[1].apply_threshold(bit_reduction, gate_ratio, full_plan);
+                        identical = identical && std::ranges::equal(chunks[0].processed_freq_lines, chunks[1].processed_freq_lines);
+                    }
+                    CHECK(identical);
+                }
+            }
+        }
+    }
+}
+
+// While a frame is stuck, the model only tracks the levels and recovers the
+// packet. Once it's unstuck, the lines should be exactly what they'd have been
+// if it had worked out the threshold and applied it the whole time.
+TEST_CASE("Skipping the threshold while stuck doesn't change the frames after", "[chunk]")
+{
+    const int num_lines = 256;
+    const floattype sample_rate = 44100;
+    const std::vector<floattype> spread_matrix = ChunkProcessor::build_spread_matrix({ 0.25, 1, 0.25 }, 1);
+    const floattype masking_amount = 0.5;
+    const floattype gate_ratio = 10;
+
+    for (floattype bit_reduction : { 0.0, 6.0 }) {
+        INFO("bits " << bit_reduction);
+        ChunkArena arena(2, num_lines);
+        // One that does all the work, and one that takes the shortcut.
+        std::vector<ChunkProcessor> full;
+        std::vector<ChunkProcessor> shortcut;
+        full.emplace_back(num_lines, sample_rate, arena, 0);
+        shortcut.emplace_back(num_lines, sample_rate, arena, 1);
+        for (auto* chunk : { &full[0], &shortcut[0] }) {
+            chunk->static_threshold = StaticThreshold::get(num_lines, sample_rate, 1e-6, 1);
+            chunk->bias_curve = BiasCurve::get(num_lines, sample_rate, 0);
+        }
+        const StagePlan plan = StagePlan::make(masking_amount, gate_ratio, bit_reduction);
+
+        std::mt19937 generator(2);
+        std::normal_distribution<double> distribution(0, 0.01);
+        bool identical = true;
+        for (int frame = 0; frame < 24; ++frame) {
+            const bool stuck = (8 <= frame) && (frame < 16);
+            for (int f = 0; f < num_lines; ++f) {
+                // Louder while stuck, so the levels move.
+                const floattype line = (floattype)distribution(generator) * (stuck ? 10 : 1);
+                full[0].raw_freq_lines[f] = line;
+                shortcut[0].raw_freq_lines[f] = line;
+            }
+
+            full[0].track_levels(0.2);
+            full[0].analyze_bands();
+            ChunkProcessor::spread_bands(spread_matrix, full);
+            full[0].build_threshold(masking_amount, plan);
+            full[0].apply_threshold(bit_reduction, gate_ratio, plan);
+
+            shortcut[0].track_levels(0.2);
+            if (not stuck) {
+                shortcut[0].analyze_bands();
+                ChunkProcessor::spread_bands(spread_matrix, shortcut);
+                shortcut[0].build_threshold(masking_amount, plan);
+                shortcut[0].apply_threshold(bit_reduction, gate_ratio, plan);
+            }
+
+            for (auto* chunk : { &full[0], &shortcut[0] }) {
+                if (stuck) {
+                    chunk->recover_packet();
+                } else {
+                    chunk->keep_frame();
+                }
+            }
+            // After keep_frame(), this frame's lines are the previous ones.
+            identical = identical && std::ranges::equal(full[0].prev_processed_lines, shortcut[0].prev_processed_lines);
+            identical = identical && std::ranges::equal(full[0].processed_freq_lines, shortcut[0].processed_freq_lines);
+        }
+        CHECK(identical);
+    }
+}
+
+TEST_CASE("Linked lines are the loudest, or the total power, of the channels' lines", "[chunk]")
+{
+    const int num_lines = 64;
+    const floattype sample_rate = 44100;
+    ChunkArena arena(2, num_lines);
+    ChunkArena link_arena(1, num_lines);
+    std::vector<ChunkProcessor> chunks;
+    chunks.emplace_back(num_lines, sample_rate, arena, 0);
+    chunks.emplace_back(num_lines, sample_rate, arena, 1);
+    ChunkProcessor link(num_lines, sample_rate, link_arena, 0);
+
+    std::mt19937 generator(3);
+    std::normal_distribution<double> distribution(0, 1);
+    for (int f = 0; f < num_lines; ++f) {
+        chunks[0].raw_freq_lines[f] = (floattype)distribution(generator);
+        chunks[1].raw_freq_lines[f] = (floattype)distribution(generator);
+    }
+
+    link.link_lines(chunks, false);
+    bool loudest = true;
+    for (int f = 0; f < num_lines; ++f) {
+        loudest = loudest && (link.raw_freq_lines[f] == std::max(std::abs(chunks[0].raw_freq_lines[f]), std::abs(chunks[1].raw_freq_lines[f])));
+    }
+    CHECK(loudest);
+
+    link.link_lines(chunks, true);
+    double max_error = 0;
+    for (int f = 0; f < num_lines; ++f) {
+        const double left = chunks[0].raw_freq_lines[f];
+        const double right = chunks[1].raw_freq_lines[f];
+        const double power = (double)link.raw_freq_lines[f] * link.raw_freq_lines[f];
+        max_error = std::max(max_error, std::abs(power - (left * left + right * right)) / (left * left + right * right));
+    }
+    CHECK(max_error < 1e-5);
+}
+
+// The band each line falls in: the last band that starts at or below it.
+static int band_of_line(const std::array<int, ChunkProcessor::NUM_BANDS + 1>& edges, int line)
+{
+    int band = 0;
+    while ((band + 1 < ChunkProcessor::NUM_BANDS) && (edges[band + 1] <= line)) {
+        ++band;
+    }
+    return band;
+}
+
+TEST_CASE("Every line falls in the critical band that covers its frequency", "[chunk]")
+{
+    SECTION("1024 lines at 44.1 kHz, about 21.5 Hz apart")
+    {
+        ChunkArena arena(1, 1024);
+        const ChunkProcessor chunk(1024, 44100, arena, 0);
+        const std::array<int, ChunkProcessor::NUM_BANDS + 1> expected = {
+            0, 5, 10, 14, 19, 24, 30, 36, 43, 51, 59, 69, 80, 93, 108, 126, 147, 172, 205, 247, 298, 358, 442, 558, 697, 1024
+        };
+        CHECK(chunk.get_band_edges() == expected);
+        // DC and 86 Hz are in the first band, 100 to 200 Hz.
+        CHECK(band_of_line(chunk.get_band_edges(), 0) == 0);
+        CHECK(band_of_line(chunk.get_band_edges(), 4) == 0);
+        CHECK(band_of_line(chunk.get_band_edges(), 5) == 1);
+        // 14987 Hz is in the 12 to 15 kHz band, and everything from 15009 Hz
+        // up to Nyquist is in the last one.
+        CHECK(band_of_line(chunk.get_band_edges(), 696) == 23);
+        CHECK(band_of_line(chunk.get_band_edges(), 697) == 24);
+        CHECK(band_of_line(chunk.get_band_edges(), 1023) == 24);
+    }
+    SECTION("8 lines at 48 kHz, 3 kHz apart")
+    {
+        // Most of the bands are too narrow to get a line, but each line still
+        // ends up in the band its frequency is in.
+        ChunkArena arena(1, 8);
+        const ChunkProcessor chunk(8, 48000, arena, 0);
+        const std::array<int, ChunkProcessor::NUM_BANDS + 1> expected = {
+            0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 4, 5, 8
+        };
+        CHECK(chunk.get_band_edges() == expected);
+        CHECK(band_of_line(chunk.get_band_edges(), 0) == 0);
+        CHECK(band_of_line(chunk.get_band_edges(), 1) == 15);
+        CHECK(band_of_line(chunk.get_band_edges(), 4) == 23);
+        CHECK(band_of_line(chunk.get_band_edges(), 7) == 24);
+    }
+}
+
+// The gate and the quantization as they were first written, a line at a time
+// in dB, in doubles.
+static double reference_line(double raw, double thresh, double gate_ratio, double bit_reduction)
+{
+    double processed = raw;
+    const double db_thresh = 10 * std::log10(thresh);
+    double db_from_thresh = 20 * std::log10(std::abs(raw)) - db_thresh;
+    if (db_from_thresh < 0) {
+        db_from_thresh *= gate_ratio;
+    }
+    processed = std::copysign(std::pow(10.0, (db_from_thresh + db_thresh) / 20), raw);
+    if (bit_reduction != 0) {
+        const double db = std::floor(20 * std::log10(std::abs(processed)) / bit_reduction) * bit_reduction;
+        processed = std::copysign(std::pow(10.0, db / 20), processed);
+    }
+    return processed;
+}
+
+// The float build's log2 and exp2 are approximations, and a steep gate
+// magnifies their error (and the floats' rounding) along with the level, to a
+// few 1e-4 dB at a ratio of 10. The double build's aren't, so its lines should
+// be as good as doubles get.
+TEST_CASE("The gate and quantization match their definitions in dB", "[chunk]")
+{
+    const int num_lines = 256;
+    const floattype sample_rate = 44100;
+    const double tolerance_db = (sizeof(floattype) == 8) ? 1e-9 : 1e-3;
+
+    for (floattype gate_ratio : { 2.0, 10.0 }) {
+        for (floattype bit_reduction : { 0.0, 1.5 }) {
+            INFO("ratio " << gate_ratio << ", bits " << bit_reduction);
+            ChunkArena arena(1, num_lines);
+            ChunkProcessor chunk(num_lines, sample_rate, arena, 0);
+            const StagePlan plan = StagePlan::make(0.5, gate_ratio, bit_reduction);
+
+            // The lines are far below the threshold's level, so the gate is
+            // open on all of them.
+            std::mt19937 generator(3);
+            std::normal_distribution<double> lines(0, 0.01);
+            std::uniform_real_distribution<double> thresholds(0.5, 2);
+            for (int f = 0; f < num_lines; ++f) {
+                chunk.raw_freq_lines[f] = (f == 0) ? 0 : (floattype)lines(generator);
+                chunk.threshold[f] = (floattype)thresholds(generator);
+            }
+            chunk.track_levels(0.2);
+            chunk.apply_threshold(bit_reduction, gate_ratio, plan);
+
+            CHECK(chunk.processed_freq_lines[0] == 0);
+            double max_error_db = 0;
+            for (int f = 1; f < num_lines; ++f) {
+                const double raw = chunk.raw_freq_lines[f];
+                const double thresh = chunk.threshold[f];
+                // Lines that land right on a quantization step could round
+                // either way, so they aren't compared.
+                if (bit_reduction != 0) {
+                    const double db = 20 * std::log10(std::abs(reference_line(raw, thresh, gate_ratio, 0)));
+                    const double steps = db / bit_reduction;
+                    if (std::abs(steps - std::round(steps)) < 1e-4) {
+                        continue;
+                    }
+                }
+                // Nor are the ones gated below the smallest normal float, where
+                // fast_exp2() stops.
+                const double expected = reference_line(raw, thresh, gate_ratio, bit_reduction);
+                if (std::abs(expected) < std::numeric_limits<float>::min()) {
+                    continue;
+                }
+                const double processed = chunk.processed_freq_lines[f];
+                CHECK(std::signbit(processed) == std::signbit(expected));
+                max_error_db = std::max(max_error_db, std::abs(20 * std::log10(std::abs(processed / expected))));
+            }
+            CHECK(max_error_db < tolerance_db);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#include <FastMath.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Checks the error bounds documented in FastMath.h, over a spread of every
+// normal float.
+static const std::uint32_t smallest_normal_bits = 0x00800000;
+static const std::uint32_t infinity_bits = 0x7f800000;
+static const std::uint32_t stride = 101;
+
+TEST_CASE("fast_log2 is within its error bounds", "[fastmath]")
+{
+    double max_error_near_one = 0;
+    double max_error_in_steps = 0;
+    for (std::uint32_t bits = smallest_normal_bits; bits < infinity_bits; bits += stride) {
+        const float x = std::bit_cast<float>(bits);
+        const double exact = std::log2((double)x);
+        const double error = std::abs((double)fast_log2(x) - exact);
+        if ((x >= 0.5f) && (x <= 2.0f)) {
+            max_error_near_one = std::max(max_error_near_one, error);
+        } else {
+            const float magnitude = (float)std::abs(exact);
+            const double step = std::nextafter(magnitude, std::numeric_limits<float>::infinity()) - magnitude;
+            max_error_in_steps = std::max(max_error_in_steps, error / step);
+        }
+    }
+    CHECK(max_error_near_one < 2e-7);
+    CHECK(max_error_in_steps < 2);
+    
+    CHECK(std::abs(fast_log2(0.0f) + 127) < 1);
+    CHECK(fast_log2(1.0f) == 0.0f);
+}
+
+TEST_CASE("fast_exp2 is within its error bounds", "[fastmath]")
+{
+    double max_error = 0;
+    for (int i = -126 * 4096; i <= 127 * 4096; ++i) {
+        const float x = i / 4096.0f + 1.0f / 8192.0f;
+        const double exact = std::exp2((double)x);
+        max_error = std::max(max_error, std::abs((double)fast_exp2(x) - exact) / exact);
+    }
+    CHECK(max_error < 3e-7);
+    
+    // Clamped, rather than going denormal.
+    CHECK(fast_exp2(-1000.0f) == std::numeric_limits<float>::min());
+    CHECK(fast_exp2(0.0f) == 1.0f);
+}
+
+TEST_CASE("fast_exp2 clamps large inputs rather than overflowing", "[fastmath]")
+{
+    // Just under 128 is still within the error bounds, just under FLT_MAX.
+    const float under_128 = std::nextafter(128.0f, 0.0f);
+    const double exact = std::exp2((double)under_128);
+    CHECK(std::abs((double)fast_exp2(under_128) - exact) / exact < 3e-7);
+    
+    // Anything bigger is treated the same, rather than spilling into the sign
+    // and exponent bits.
+    for (float x : { 128.0f, 129.0f, 200.0f, 1000.0f, 1e30f, std::numeric_limits<float>::max(), std::numeric_limits<float>::infinity() }) {
+        INFO("x = " << x);
+        CHECK(fast_exp2(x) == fast_exp2(under_128));
+    }
+    
+    // Everything in between is finite, and only ever goes up.
+    float previous = 0;
+    for (int i = 120 * 4096; i <= 140 * 4096; ++i) {
+        const float result = fast_exp2(i / 4096.0f);
+        CHECK(std::isfinite(result));
+        CHECK(result >= previous);
+        previous = result;
+    }
+}
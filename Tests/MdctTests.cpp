@@ -0,0 +1,529 @@
+#include <EmpyModel.h>
+#include <mdct.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Every MDCT size the plugin uses: twice each of the frequency resolutions.
+static const std::vector<int> mdct_sizes = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+
+static std::vector<FourierBackend> backends_for_size(int num_samples)
+{
+    std::vector<FourierBackend> backends = { FourierBackend::split_radix };
+#if !USE_DOUBLE
+    backends.push_back(FourierBackend::juce);
+#endif
+    if (num_samples <= MdctPlan::MAX_DIRECT_SIZE) {
+        backends.push_back(FourierBackend::direct);
+    }
+    return backends;
+}
+
+static std::vector<floattype> random_signal(int length, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    std::vector<floattype> signal(length);
+    for (auto& s : signal) {
+        s = (floattype)distribution(generator);
+    }
+    return signal;
+}
+
+// The MDCT straight from its definition, in doubles. The transform is the
+// DCT-IV of the folded frame, which works out as
+//   X[k] = 1 / sqrt(N) * sum(w[n] * x[n] * cos(2 pi / N * (n + 1/2 + N/4) * (k + 1/2)))
+// and the inverse (before overlap-adding) is
+//   y[n] = 4 / sqrt(N) * w[n] * sum(X[k] * cos(2 pi / N * (n + 1/2 + N/4) * (k + 1/2)))
+// with the same scaling as ModifiedDiscreteCosineTransform.
+static double reference_cos(int num_samples, int n, int k)
+{
+    const double pi = 3.14159265358979323846;
+    return std::cos(2.0 * pi / num_samples * (n + 0.5 + num_samples / 4.0) * (k + 0.5));
+}
+
+static std::vector<double> reference_transform(const std::vector<floattype>& window, const std::vector<floattype>& frame)
+{
+    const int num_samples = (int)frame.size();
+    std::vector<double> freq_vals(num_samples / 2, 0);
+    for (int k = 0; k < num_samples / 2; ++k) {
+        double sum = 0;
+        for (int n = 0; n < num_samples; ++n) {
+            sum += (double)window[n] * frame[n] * reference_cos(num_samples, n, k);
+        }
+        freq_vals[k] = sum / std::sqrt((double)num_samples);
+    }
+    return freq_vals;
+}
+
+static std::vector<double> reference_inverse(const std::vector<floattype>& window, const std::vector<floattype>& freq_vals)
+{
+    const int num_samples = (int)window.size();
+    std::vector<double> frame(num_samples, 0);
+    for (int n = 0; n < num_samples; ++n) {
+        double sum = 0;
+        for (int k = 0; k < num_samples / 2; ++k) {
+            sum += freq_vals[k] * reference_cos(num_samples, n, k);
+        }
+        frame[n] = 4.0 * window[n] * sum / std::sqrt((double)num_samples);
+    }
+    return frame;
+}
+
+// The largest error we accept, relative to the largest value in the result.
+// Single precision FFTs lose a little accuracy with each stage.
+static double tolerance([[maybe_unused]] int num_samples)
+{
+#if USE_DOUBLE
+    return 1e-10;
+#else
+    return 2e-6 * std::log2((double)num_samples);
+#endif
+}
+
+template <typename A, typename B>
+static double relative_error(const std::vector<A>& result, const std::vector<B>& expected)
+{
+    double max_error = 0;
+    double max_value = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        max_error = std::max(max_error, std::abs((double)result[i] - (double)expected[i]));
+        max_value = std::max(max_value, std::abs((double)expected[i]));
+    }
+    return max_error / max_value;
+}
+
+TEST_CASE("MDCT matches the reference DCT-IV", "[mdct]")
+{
+    for (int num_samples : mdct_sizes) {
+        const int half = num_samples / 2;
+        // Hold on to the plan, so the window stays around.
+        const auto plan = MdctPlan::get(num_samples, WindowShape::sine, WindowTransition::none);
+        const std::vector<floattype>& window = plan->window;
+        const std::vector<floattype> frame = random_signal(num_samples, num_samples);
+        const std::vector<double> expected = reference_transform(window, frame);
+
+        for (auto backend : backends_for_size(num_samples)) {
+            INFO("size " << num_samples << ", backend " << (int)backend);
+            ModifiedDiscreteCosineTransform mdct(num_samples, 1, backend);
+
+            std::vector<floattype> freq_vals(half);
+            mdct.transform(&frame[0], &frame[half], &freq_vals[0]);
+            CHECK(relative_error(freq_vals, expected) < tolerance(num_samples));
+        }
+    }
+}
+
+TEST_CASE("Inverse MDCT matches the reference", "[mdct]")
+{
+    for (int num_samples : mdct_sizes) {
+        const int half = num_samples / 2;
+        // Hold on to the plan, so the window stays around.
+        const auto plan = MdctPlan::get(num_samples, WindowShape::sine, WindowTransition::none);
+        const std::vector<floattype>& window = plan->window;
+        const std::vector<floattype> freq_vals = random_signal(half, num_samples + 1);
+        const std::vector<double> expected = reference_inverse(window, freq_vals);
+
+        for (auto backend : backends_for_size(num_samples)) {
+            INFO("size " << num_samples << ", backend " << (int)backend);
+            ModifiedDiscreteCosineTransform mdct(num_samples, 1, backend);
+
+            // The inverse adds to what's already there.
+            std::vector<floattype> frame(num_samples, 0.5);
+            mdct.inverseTransform(&frame[0], &frame[half], &freq_vals[0]);
+            for (auto& s : frame) {
+                s -= (floattype)0.5;
+            }
+            CHECK(relative_error(frame, expected) < tolerance(num_samples));
+        }
+    }
+}
+
+TEST_CASE("MDCT hop transform matches one channel at a time", "[mdct]")
+{
+    const int num_samples = 256;
+    const int half = num_samples / 2;
+    const int num_channels = 3;
+    ModifiedDiscreteCosineTransform single(num_samples, 1);
+    // Fewer channels of scratch than we pass, so the channels go in groups.
+    ModifiedDiscreteCosineTransform hop(num_samples, 2);
+
+    std::vector<std::vector<floattype>> samples(num_channels);
+    std::vector<std::vector<floattype>> freqs(num_channels, std::vector<floattype>(half));
+    std::vector<floattype*> sample_pointers;
+    std::vector<floattype*> freq_pointers;
+    for (int c = 0; c < num_channels; ++c) {
+        samples[c] = random_signal(num_samples, 10 + c);
+        sample_pointers.push_back(samples[c].data());
+        freq_pointers.push_back(freqs[c].data());
+    }
+
+    // Starting halfway through, the frame wraps around the buffer.
+    for (int start_pos : { 0, half }) {
+        hop.transform_hop(sample_pointers, freq_pointers, start_pos);
+        for (int c = 0; c < num_channels; ++c) {
+            std::vector<floattype> expected(half);
+            single.transform(&samples[c][start_pos], &samples[c][half - start_pos], &expected[0]);
+            CHECK(relative_error(freqs[c], expected) < tolerance(num_samples));
+        }
+    }
+}
+
+// Transforms a long random signal in overlapping frames and adds the inverse
+// transforms back together. The aliasing in each half of a frame should
+// cancel with its neighbour's, leaving the original signal, apart from at the
+// very start and end.
+static double overlap_add_error(int num_samples, FourierBackend backend, WindowShape shape)
+{
+    const int half = num_samples / 2;
+    const int frames = 16;
+    const std::vector<floattype> input = random_signal(half * (frames + 1), num_samples + 2);
+    std::vector<floattype> output(input.size(), 0);
+    std::vector<floattype> freq_vals(half);
+    ModifiedDiscreteCosineTransform mdct(num_samples, 1, backend, shape);
+    for (int f = 0; f < frames; ++f) {
+        const int start = f * half;
+        mdct.transform(&input[start], &input[start + half], &freq_vals[0]);
+        mdct.inverseTransform(&output[start], &output[start + half], &freq_vals[0]);
+    }
+    double max_error = 0;
+    for (int i = half; i < half * frames; ++i) {
+        max_error = std::max(max_error, std::abs((double)output[i] - (double)input[i]));
+    }
+    return max_error;
+}
+
+TEST_CASE("MDCT overlap-add cancels the aliasing", "[mdct]")
+{
+    for (int num_samples : mdct_sizes) {
+        for (auto backend : backends_for_size(num_samples)) {
+            for (auto shape : { WindowShape::sine, WindowShape::kbd, WindowShape::vorbis, WindowShape::low_overlap }) {
+                INFO("size " << num_samples << ", backend " << (int)backend << ", window " << (int)shape);
+                CHECK(overlap_add_error(num_samples, backend, shape) < 10 * tolerance(num_samples));
+            }
+        }
+    }
+}
+
+// Runs a signal through the model with every processing stage set so it does
+// nothing, in awkwardly sized blocks, and checks that what comes out is the
+// input, delayed by exactly the latency the model reports. The model moves on
+// to the next of stereo_modes, and the next of mixes, every block. Since the
+// wet signal is the input too, any mix should come out the same, as long as
+// the dry signal is mixed in at the right time.
+static double model_reconstruction_error(int lines, WindowShape shape, bool block_switching,
+                                         const std::vector<StereoMode>& stereo_modes = { StereoMode::separate },
+                                         const std::vector<floattype>& mixes = { 100 })
+{
+    const int num_channels = 2;
+    EmpyModel model;
+    model.prepare(1024, 44100, num_channels);
+    model.set_mask_threshold(0);
+    model.set_absolute_threshold(0);
+    model.set_spread_distance(2);
+    model.set_bit_reduction_above_threshold(0);
+    model.set_speed(0);
+    model.set_perceptual_curve(1);
+    model.set_mix(100);
+    model.set_gate_ratio(1);
+    model.set_mdct_size(lines);
+    model.set_window_shape(shape);
+    model.set_block_switching(block_switching);
+    model.set_packet_loss(0, 0.5, 3);
+    model.set_bias(0);
+    model.set_stick_freeze(false);
+
+    // Clicks every so often, so that block switching has something to do. The
+    // channels are different, so mid/side has a side to work on.
+    const int length = lines * 12 + 4000;
+    std::vector<std::vector<floattype>> input(num_channels);
+    for (int c = 0; c < num_channels; ++c) {
+        input[c] = random_signal(length, lines + c);
+        for (int i = 0; i < length; ++i) {
+            input[c][i] *= (i % 1500 < 100) ? (floattype)0.9 : (floattype)0.05;
+        }
+    }
+
+    std::vector<std::vector<floattype>> output(num_channels, std::vector<floattype>(length));
+    int pos = 0;
+    int block = 0;
+    while (pos < length) {
+        model.set_stereo_mode(stereo_modes[block % stereo_modes.size()]);
+        model.set_mix(mixes[block % mixes.size()]);
+        const int block_size = std::min(length - pos, 61 + 17 * (block++ % 5));
+        juce::AudioBuffer<float> buffer(num_channels, block_size);
+        for (int c = 0; c < num_channels; ++c) {
+            for (int i = 0; i < block_size; ++i) {
+                buffer.getWritePointer(c)[i] = (float)input[c][pos + i];
+            }
+        }
+        model.processBlock(buffer);
+        for (int c = 0; c < num_channels; ++c) {
+            for (int i = 0; i < block_size; ++i) {
+                output[c][pos + i] = buffer.getWritePointer(c)[i];
+            }
+        }
+        pos += block_size;
+    }
+
+    const int latency = model.get_latency_samples();
+    double max_error = 0;
+    for (int c = 0; c < num_channels; ++c) {
+        for (int i = 2 * latency; i < length; ++i) {
+            max_error = std::max(max_error, std::abs((double)output[c][i] - (double)input[c][i - latency]));
+        }
+    }
+    return max_error;
+}
+
+TEST_CASE("EmpyModel reconstructs its input when it has nothing to do", "[mdct][model]")
+{
+    for (int lines : { 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 }) {
+        for (auto shape : { WindowShape::sine, WindowShape::kbd, WindowShape::vorbis, WindowShape::low_overlap }) {
+            INFO("lines " << lines << ", window " << (int)shape);
+            CHECK(model_reconstruction_error(lines, shape, false) < 1e-5);
+        }
+        INFO("lines " << lines << ", block switching");
+        CHECK(model_reconstruction_error(lines, WindowShape::sine, true) < 1e-5);
+    }
+}
+
+TEST_CASE("EmpyModel reconstructs its input in every stereo mode", "[mdct][model]")
+{
+    const std::vector<StereoMode> all_modes = { StereoMode::separate, StereoMode::linked_max, StereoMode::linked_sum, StereoMode::mid_side };
+    for (int lines : { 16, 256, 2048 }) {
+        for (bool block_switching : { false, true }) {
+            for (auto mode : all_modes) {
+                INFO("lines " << lines << ", block switching " << block_switching << ", mode " << (int)mode);
+                CHECK(model_reconstruction_error(lines, WindowShape::sine, block_switching, { mode }) < 1e-5);
+            }
+            // Switching between them as we go, which converts what's in the
+            // buffers to and from mid/side.
+            INFO("lines " << lines << ", block switching " << block_switching << ", switching modes");
+            CHECK(model_reconstruction_error(lines, WindowShape::sine, block_switching, all_modes) < 1e-5);
+        }
+    }
+}
+
+TEST_CASE("EmpyModel mixes in the dry signal in time with the wet", "[mdct][model]")
+{
+    // All dry, half and half, and changing every block, so the mix changes
+    // partway through frames.
+    const std::vector<std::vector<floattype>> mix_cases = { { 0 }, { 50 }, { 0, 30, 100, 75, 50 } };
+    for (int lines : { 4, 16, 256, 2048 }) {
+        for (auto shape : { WindowShape::sine, WindowShape::low_overlap }) {
+            for (bool block_switching : { false, true }) {
+                for (const auto& mixes : mix_cases) {
+                    INFO("lines " << lines << ", window " << (int)shape << ", block switching " << block_switching
+                         << ", mixes " << mixes.size() << " starting at " << mixes[0]);
+                    CHECK(model_reconstruction_error(lines, shape, block_switching, { StereoMode::separate }, mixes) < 1e-5);
+                }
+            }
+        }
+    }
+}
+
+// The settings that need a static threshold and a bias curve, then the
+// resolution, in either order. Offline, the message thread never gets a look
+// in, as it might not in a fast render. Otherwise, it gets one after the
+// settings change, as it would within a timer tick.
+static std::vector<float> model_output_with_thresholds(int lines, bool block_switching, bool resolution_first, bool offline)
+{
+    const int num_channels = 2;
+    EmpyModel model;
+    model.prepare(1024, 44100, num_channels);
+    model.set_non_realtime(offline);
+    model.set_mask_threshold(0.5);
+    model.set_spread_distance(2);
+    model.set_bit_reduction_above_threshold(0);
+    model.set_speed(0.2);
+    model.set_mix(100);
+    // The thresholds only do anything through the gate.
+    model.set_gate_ratio(10);
+    model.set_block_switching(block_switching);
+    model.set_packet_loss(0, 0.5, 3);
+    model.set_stick_freeze(false);
+    if (resolution_first) {
+        model.set_mdct_size(lines);
+    }
+    model.set_absolute_threshold(0.8);
+    model.set_perceptual_curve(0.7);
+    model.set_bias(0.5);
+    if (not offline) {
+        model.refresh_tables();
+    }
+    if (not resolution_first) {
+        model.set_mdct_size(lines);
+    }
+
+    const int length = lines * 8 + 4000;
+    std::vector<float> output;
+    int pos = 0;
+    while (pos < length) {
+        const int block_size = std::min(length - pos, 256);
+        juce::AudioBuffer<float> buffer(num_channels, block_size);
+        for (int c = 0; c < num_channels; ++c) {
+            const std::vector<floattype> noise = random_signal(block_size, pos + c);
+            for (int i = 0; i < block_size; ++i) {
+                buffer.getWritePointer(c)[i] = (float)noise[i] * (((pos + i) % 1500 < 100) ? 0.9f : 0.05f);
+            }
+        }
+        model.processBlock(buffer);
+        for (int c = 0; c < num_channels; ++c) {
+            output.insert(output.end(), buffer.getWritePointer(c), buffer.getWritePointer(c) + block_size);
+        }
+        pos += block_size;
+    }
+    return output;
+}
+
+TEST_CASE("EmpyModel has the tables for new settings and a new resolution from the next block offline", "[model]")
+{
+    for (int lines : { 16, 256, 2048 }) {
+        for (bool block_switching : { false, true }) {
+            INFO("lines " << lines << ", block switching " << block_switching);
+            const std::vector<float> refreshed = model_output_with_thresholds(lines, block_switching, true, false);
+            CHECK(model_output_with_thresholds(lines, block_switching, false, false) == refreshed);
+            CHECK(model_output_with_thresholds(lines, block_switching, false, true) == refreshed);
+            CHECK(model_output_with_thresholds(lines, block_switching, true, true) == refreshed);
+        }
+    }
+}
+
+// What the model's graph shows for the static threshold (times the bias) at
+// a resolution, in dB, for the slider settings.
+static std::vector<floattype> static_threshold_line(int lines, floattype slider, floattype curve, floattype bias)
+{
+    const floattype level = StaticThreshold::quantize_level(std::pow(10.f, slider * 25 - 22));
+    const auto threshold = StaticThreshold::get(lines, 44100, level, curve);
+    const auto bias_curve = BiasCurve::get(lines, 44100, bias);
+    std::vector<floattype> line(lines);
+    for (int f = 0; f < lines; ++f) {
+        line[f] = std::log10(threshold->values[f] * bias_curve->values[f]) * 10;
+    }
+    return line;
+}
+
+static double max_difference(const std::vector<floattype>& a, const std::vector<floattype>& b, int length)
+{
+    double difference = 0;
+    for (int i = 0; i < length; ++i) {
+        difference = std::max(difference, (double)std::abs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+TEST_CASE("EmpyModel's other resolutions keep up with settings that change every block", "[model]")
+{
+    const int num_channels = 2;
+    EmpyModel model;
+    model.prepare(1024, 44100, num_channels);
+    model.set_mask_threshold(0.5);
+    model.set_spread_distance(2);
+    model.set_bit_reduction_above_threshold(0);
+    model.set_speed(0.2);
+    model.set_mix(100);
+    model.set_gate_ratio(10);
+    model.set_packet_loss(0, 0.5, 3);
+    model.set_stick_freeze(false);
+    model.set_perceptual_curve(0.7);
+    model.set_bias(0);
+    const auto slider = [](int block) { return (floattype)0.5 + block * (floattype)0.01; };
+    model.set_absolute_threshold(slider(0));
+    model.refresh_tables();
+    
+    // The static threshold moves every block, and the message thread only
+    // gets a look in between them, so the settings have always moved on by
+    // the time the tables it made for them are taken.
+    juce::AudioBuffer<float> buffer(num_channels, 256);
+    buffer.clear();
+    const int num_blocks = 20;
+    for (int block = 1; block <= num_blocks; ++block) {
+        model.set_absolute_threshold(slider(block));
+        model.processBlock(buffer);
+        model.refresh_tables();
+    }
+    
+    // The threshold keeps moving as the resolution changes, and the new
+    // resolution has the tables for the settings the message thread last
+    // saw, rather than waiting for the threshold to stop.
+    const int new_lines = 256;
+    model.set_mdct_size(new_lines);
+    model.set_absolute_threshold(slider(num_blocks + 1));
+    model.request_graph_lines(GraphOverlay::static_threshold);
+    model.processBlock(buffer);
+    const std::vector<floattype> expected = static_threshold_line(new_lines, slider(num_blocks), (floattype)0.7, 0);
+    CHECK(max_difference(model.graphScaledLines.static_threshold, expected, new_lines) < 1e-3);
+}
+
+TEST_CASE("EmpyModel uses a new bias from the next block on", "[model]")
+{
+    // The bias curves are all made in prepare(), so unlike the static
+    // threshold, the bias doesn't wait for refresh_tables().
+    const int num_channels = 2;
+    const int lines = 256;
+    EmpyModel model;
+    model.prepare(lines, 44100, num_channels);
+    model.set_mask_threshold(0.5);
+    model.set_spread_distance(2);
+    model.set_bit_reduction_above_threshold(0);
+    model.set_speed(0.2);
+    model.set_mix(100);
+    model.set_gate_ratio(10);
+    model.set_packet_loss(0, 0.5, 3);
+    model.set_stick_freeze(false);
+    model.set_perceptual_curve(0.7);
+    model.set_absolute_threshold(0.8);
+    model.set_bias(0);
+    // As prepareToPlay() does, so the static threshold is there from the
+    // start.
+    model.refresh_tables();
+    
+    juce::AudioBuffer<float> buffer(num_channels, lines);
+    buffer.clear();
+    for (int block = 0; block <= 10; ++block) {
+        const floattype bias = (floattype)-2 + block * (floattype)0.4;
+        INFO("bias " << bias);
+        model.set_bias(bias);
+        model.request_graph_lines(GraphOverlay::static_threshold);
+        model.processBlock(buffer);
+        CHECK(model.graphScaledLines.bias == BiasCurve::get(lines, 44100, bias)->decibels);
+        const std::vector<floattype> expected = static_threshold_line(lines, (floattype)0.8, (floattype)0.7, bias);
+        CHECK(max_difference(model.graphScaledLines.static_threshold, expected, lines) < 1e-3);
+    }
+}
+
+TEST_CASE("EmpyModel's unused short frames don't keep old tables alive", "[model]")
+{
+    // If they did, turning block switching back on would let go of the last
+    // reference to one, on the audio thread.
+    const int num_channels = 2;
+    const int lines = 1024;
+    const int short_lines = lines / MdctPlan::SHORT_FRAMES;
+    EmpyModel model;
+    model.prepare(lines, 44100, num_channels);
+    model.set_gate_ratio(10);
+    model.set_perceptual_curve(0.7);
+    model.set_block_switching(true);
+    const auto slider_level = [](floattype slider) { return StaticThreshold::quantize_level(std::pow(10.f, slider * 25 - 22)); };
+    model.set_absolute_threshold(0.5);
+    model.refresh_tables();
+    juce::AudioBuffer<float> buffer(num_channels, 256);
+    buffer.clear();
+    model.processBlock(buffer);
+    const std::weak_ptr<const StaticThreshold> old_short = StaticThreshold::get(short_lines, 44100, slider_level(0.5), 0.7);
+    CHECK(not old_short.expired());
+    
+    // Two more settings go through, so the message thread has let go of the
+    // set the old one was in.
+    model.set_block_switching(false);
+    for (floattype slider : { 0.6f, 0.7f }) {
+        model.set_absolute_threshold(slider);
+        model.refresh_tables();
+        model.processBlock(buffer);
+    }
+    CHECK(old_short.expired());
+}